@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#if (COMMAND_QUEUE_LENGTH & (COMMAND_QUEUE_LENGTH - 1)) != 0
+#error COMMAND_QUEUE_LENGTH must be a power of 2
+#endif
+
+command_t command_queue[COMMAND_QUEUE_LENGTH];
+uint8_t command_queue_head, command_queue_tail, command_queue_count;
+
+#endif
@@ -66,11 +66,31 @@ const uint8_t PIN_ENC_GND PROGMEM = A9;
 #define MIN_BTN_PRESSED_TIME 100
 
 
+/*****************************/
+/*            LCD            */
+/*****************************/
+// Menus draw into a copy of the screen in RAM and only changed characters are written to the LCD, a few per tick of
+// loop() (each one takes hundreds of us over I2C). Number of characters written per tick
+#define LCD_FLUSH_CELLS 4
+
+// Time an error of the job is shown before the pause menu (ms, the button skips it)
+#define LCD_ERROR_TIME_MS 2000
+
+
 /********************************************/
 /*            Needle sensor pins            */
 /********************************************/
 const uint8_t PIN_NEEDLE_SENSOR PROGMEM = 19;
 
+// Number of needle periods averaged for the speed (power of 2)
+#define NEEDLE_SENSOR_PERIODS 8
+
+// Pulses closer than this to the previous one are double-fired edges (us, 3000 rpm)
+#define NEEDLE_SENSOR_MIN_PERIOD_US 20000
+
+// Needle is stopped if there was no pulse for this time (us)
+#define NEEDLE_SENSOR_TIMEOUT_US 1000000
+
 
 /***************************************/
 /*            Tension servo            */
@@ -79,12 +99,44 @@ const uint8_t PIN_SERVO PROGMEM = 11;
 # define SERVO_LOW_TENSION_US 800
 # define SERVO_HIGH_TENSION_US 2200
 
+// Servo slew model: pulse change per ms (us, 60 degrees in 0.15 s) and settling time after the move (ms)
+#define SERVO_SLEW_US_PER_MS 4
+#define SERVO_SETTLE_MS 30
+
+// Change thread tension (M41/M42) during the preceding hoop move, early enough for the servo to finish with the move
+// (by the slew model). The dwell that directly follows a tension change only waits for the rest of the servo move.
+// Comment to change the tension in its place and keep the dwells
+//#define TENSION_SCHEDULING
+
 
 /******************************************/
 /*            Speed controller            */
 /******************************************/
 const uint8_t SPEED_CONTROLLER_PIN PROGMEM = 46;
 
+// Main motor is a DC (universal) motor driven by PWM on SPEED_CONTROLLER_PIN (Timer5) instead of the Z stepper.
+// The speed is held by PID with the needle sensor period as the feedback (one sample per revolution). Single stitches
+// slow down to the positioning speed before the needle-up pulse, the power is cut at the pulse and the motor coasts.
+// Requires Z_STOP_COMPENSATION and Z_POSITION_STITCH to be commented. Tune with tools/motor_sim.cpp
+//#define DC_MAIN_MOTOR
+
+// Timer5 prescaler bits of the PWM (1 - 31.4 kHz, 2 - 3.9 kHz, 3 - 490 Hz)
+#define SPEED_CONTROLLER_PWM_PRESCALER 1
+
+// Feed-forward: PWM that just starts the motor and speed at full PWM (rpm)
+#define SPEED_CONTROLLER_PWM_MIN 40
+#define SPEED_CONTROLLER_RPM_MAX 1000
+
+// PID gains (1/256 of PWM per rpm, per rpm*s, per rpm/s)
+#define SPEED_CONTROLLER_KP 48
+#define SPEED_CONTROLLER_KI 96
+#define SPEED_CONTROLLER_KD 2
+
+// Single stitch: positioning speed (rpm), time at it before the needle-up pulse (ms) and time to standstill (ms)
+#define SPEED_CONTROLLER_POSITIONING_RPM 90
+#define SPEED_CONTROLLER_PRE_BRAKE_MS 200
+#define SPEED_CONTROLLER_COAST_MS 200
+
 
 /*********************************/
 /*            SD Card            */
@@ -95,8 +147,119 @@ const uint8_t PIN_SD_CARD_CS = 53;
 #define SD_FAT_TYPE 0
 #define FILE_EXT_UPPER ".GCODE"
 #define FILE_EXT_LOWER ".gcode"
+#define FILE_EXT_OEB_UPPER ".OEB"
+#define FILE_EXT_OEB_LOWER ".oeb"
+#define FILE_EXT_DST_UPPER ".DST"
+#define FILE_EXT_DST_LOWER ".dst"
 #define MAX_FILE_NAME_LENGTH 50
-#define MAX_GCODE_LINE_LENGTH 50
+// Maximum number of files in the browser (2 bytes of RAM each, up to 256), the oldest files are not shown
+#define SD_INDEX_MAX_FILES 200
+
+
+/****************************************/
+/*            G-code handler            */
+/****************************************/
+// Number of pre-decoded commands (read-ahead), must be a power of 2
+#define COMMAND_QUEUE_LENGTH 16
+
+// Keep the main motor running between stitches (M3 .. I1) and move the hoop while the needle is up.
+// Moves that don't fit into the needle-up window (long jumps), dwells, pauses, etc. are made with the stopped motor.
+// Comment to stop the motor after each stitch
+//#define CONTINUOUS_NEEDLE
+
+// Part of the needle revolution after the needle sensor pulse when the needle is above the fabric
+#define NEEDLE_UP_WINDOW_PERCENT 40
+
+// Choose the needle speed of each stitch (M3 .. I1) in the firmware, the S value of the file is ignored.
+// Short stitches are made at the maximum speed and longer ones slower. With CONTINUOUS_NEEDLE the speed is lowered
+// only as much as the next hoop move needs to fit into the needle-up window. After the main motor is stopped (M5)
+// the speed starts from the minimum and goes up by the ramp with each stitch. Comment to use speeds from the file
+//#define ADAPTIVE_NEEDLE_SPEED
+
+// Speed range (steps/s), increase per stitch and speed step (fewer different speeds for Z_STOP_COMPENSATION)
+#define ADAPTIVE_NEEDLE_SPEED_MIN_HZ 700
+#define ADAPTIVE_NEEDLE_SPEED_MAX_HZ 1800
+#define ADAPTIVE_NEEDLE_SPEED_RAMP_HZ 220
+#define ADAPTIVE_NEEDLE_SPEED_STEP_HZ 200
+
+// Stitches up to the short length are made at the maximum speed, from the long length at the minimum speed
+// (hundredths of mm)
+#define ADAPTIVE_NEEDLE_SHORT_STITCH 500
+#define ADAPTIVE_NEEDLE_LONG_STITCH 1000
+
+// Tune the needle speed of stitches during the job: after each window of stitches the speed goes up by a step while the
+// needle keeps in sync with the hoop and down when the sync degrades (the needle stops past the needle-up window, with
+// CONTINUOUS_NEEDLE the hoop move ends after the window or pulses of the running needle are missed). The speed isn't
+// raised again to the level that degraded. Speed settled for the design is stored in the index file on the SD card and
+// the next run of the design starts with it. Comment to use the speeds as they are
+//#define SPEED_GOVERNOR
+
+// Speed range (% of the speed from the file or ADAPTIVE_NEEDLE_SPEED), speed step and the speed limit (steps/s)
+#define SPEED_GOVERNOR_MIN_PERCENT 70
+#define SPEED_GOVERNOR_MAX_PERCENT 160
+#define SPEED_GOVERNOR_STEP_PERCENT 5
+#define SPEED_GOVERNOR_MAX_HZ 2400
+
+// Stitches per decision and late stitches in them that are still tolerated
+#define SPEED_GOVERNOR_WINDOW 32
+#define SPEED_GOVERNOR_LATE_STITCHES 1
+
+
+/**************************************/
+/*            DST playback            */
+/**************************************/
+// Jump and stitch speeds, XY accelerations (same as default settings of OpenEmbroidery.py)
+#define DST_JUMP_SPEED_MM_S 30
+#define DST_STITCH_SPEED_MM_S 150
+#define DST_ACCELERATION_X_MM_S 800
+#define DST_ACCELERATION_Y_MM_S 800
+
+// Needle speed ramp: the first DST_LOW_SPEED_STITCHES stitches after each jump are made with low speed
+#define DST_NEEDLE_LOW_SPEED_HZ 700
+#define DST_NEEDLE_HIGH_SPEED_HZ 1800
+#define DST_ACCELERATION_Z_LOW_HZ 3024      // DST_ACCELERATION_Z_HIGH_HZ * (low speed / high speed)^2
+#define DST_ACCELERATION_Z_HIGH_HZ 20000
+#define DST_LOW_SPEED_STITCHES 5
+
+// Pause after the low speed stitches to trim the thread tail (M0 C101). Comment to disable
+#define DST_TRIM_PAUSE
+
+// Delay after each tension change
+#define DST_TENSION_DWELL_MS 500
+
+// Move around the design outline (from the file header) before the first color. Comment to disable
+#define DST_OUTLINE_PREVIEW
+
+
+/**************************************/
+/*            Job pre-scan            */
+/**************************************/
+// Read the whole file before the start to count stitches and estimate the job time
+// (done once per file, results are stored in the index file). Comment to read only headers of .OEB and .DST files
+#define JOB_PRE_SCAN
+
+// Scan runs in loop() in slices of this time (ms), the pre-start menu shows its progress meanwhile
+#define JOB_PRE_SCAN_SLICE_MS 20
+
+// Working area of the hoop (designs that don't fit are marked on the pre-start screen)
+#define HOOP_WIDTH_MM 130
+#define HOOP_HEIGHT_MM 180
+
+
+/***********************************/
+/*            Scheduler            */
+/***********************************/
+// loop() runs tasks in priority order: motion (hoop feed, main motor, job commands), read-ahead of the job file,
+// menus, LCD update and debug log. During the job a lower priority task waits while motion has the next command ready
+// or while its measured worst-case execution time doesn't fit into the rest of the tick budget (us)
+#define SCHEDULER_TICK_BUDGET_US 4000
+
+// Longest time a task can be held back by the budget (ms)
+#define SCHEDULER_MAX_DELAY_MS 200
+
+// Periods of the menu and debug log tasks (ms)
+#define SCHEDULER_UI_PERIOD_MS 20
+#define SCHEDULER_LOG_PERIOD_MS 1000
 
 
 /****************************************/
@@ -111,6 +274,50 @@ const int32_t STEPS_PER_MM_Y PROGMEM = 65;
 #define ACCELERATION_INITIAL_Y_MM_S 500
 #define ACCELERATION_INITIAL_Z_HZ 10000
 
+// Move X and Y along one shared speed ramp (step timings are queued for both motors, so they start and stop together).
+// Comment to move each axis with its own ramp
+#define COORDINATED_MOVES
+
+// Keep the hoop moving through the end point of a move if the next command is also a move (requires
+// COORDINATED_MOVES). Speed at the point is limited by the allowed deviation from the corner (hundredths of mm).
+// Comment to stop at every point
+#define JUNCTION_DEVIATION 5
+
+// Limit jerk of X and Y, so the speed ramps are S-curves instead of trapezoids (requires COORDINATED_MOVES).
+// The hoop doesn't ring at the start and end of moves, so higher accelerations can be used (tools/ramp_sim.cpp
+// compares both ramps). Jerk can be changed with M201 J. Comment to use constant acceleration
+//#define S_CURVE_MOVES
+
+// Initial jerk of X and Y (mm/s^3, S_CURVE_MOVES)
+#define JERK_INITIAL_XY_MM_S3 50000
+
+// Drop commands that change nothing (same acceleration, tension or progress, moves to the current position) before
+// they are queued and merge consecutive moves along one line. Comment to execute the file as is
+#define COMMAND_OPTIMIZER
+
+// Consecutive moves with the same speed are merged if the middle point is this close to the line (hundredths of mm)
+#define COMMAND_OPTIMIZER_DEVIATION 2
+
+// Z motor steps per one needle revolution (measured value is printed with DEBUG at the end of the job)
+#define STEPS_PER_REVOLUTION_Z 200
+
+// Stop-and-go stitch (M3 .. I1) moves Z exactly one revolution to the needle-up position, counted from
+// the last needle sensor pulse (it only corrects the drift). Requires correct STEPS_PER_REVOLUTION_Z.
+// Not used for stitches with CONTINUOUS_NEEDLE. Comment to rotate until the needle sensor pulse and stop with deceleration
+//#define Z_POSITION_STITCH
+
+// Needle-up stop position after the needle sensor pulse (Z steps)
+#define NEEDLE_UP_OFFSET_STEPS 0
+
+// Learn Z steps from the stop command to standstill for each Z speed and acceleration (stored in EEPROM) and start
+// the stop of stop-and-go stitches early, so the needle stops at the needle-up position at any speed.
+// The stop is started early only if the measured steps per revolution match STEPS_PER_REVOLUTION_Z.
+// Comment to always stop at the needle sensor pulse
+#define Z_STOP_COMPENSATION
+
+// Number of learned speed and acceleration pairs
+#define Z_STOP_TABLE_SIZE 8
+
 // 15000 1200
 
 #endif
@@ -37,11 +37,78 @@ extern volatile uint8_t system_state;
 #define STATE_PAUSE 4
 #define STATE_STOP_CONFIRMATION 5
 
+// Types of job files
+#define FILE_TYPE_NONE 0
+#define FILE_TYPE_GCODE 1
+#define FILE_TYPE_OEB 2
+#define FILE_TYPE_DST 3
+
+// Pre-decoded commands (G-code lines are converted into them by the read-ahead)
+#define COMMAND_MOVE 0          // G0/G1: x, y - position (hundredths of mm), value - speed (mm/s)
+#define COMMAND_DWELL 1         // G4: value - delay (ms)
+#define COMMAND_PAUSE 2         // M0: value - paused code
+#define COMMAND_START_Z 3       // M3: value - speed (steps/s), flags - COMMAND_FLAG_UNTIL_INTERRUPT
+#define COMMAND_STOP_Z 4        // M5
+#define COMMAND_ENABLE 5        // M17
+#define COMMAND_DISABLE 6       // M18
+#define COMMAND_TENSION 7       // M41/M42: value - 0 (no tension) or 1 (high tension)
+#define COMMAND_PROGRESS 8      // M73: value - progress (0 to 100)
+#define COMMAND_ACCELERATION 9  // M201: x, y - accelerations (mm/s^2), value - Z acceleration (steps/s^2)
+#define COMMAND_JERK 10         // M201 J: value - X and Y jerk (mm/s^3)
+
+#define COMMAND_FLAG_UNTIL_INTERRUPT 1
+#define COMMAND_FLAG_SERVO_SETTLE 2     // Dwell directly after a tension change only waits for the servo
+
+// States of the last started X/Y move (see motors_get_move_state())
+#define MOVE_STATE_DONE 0       // Motors are stopped (or nothing was started)
+#define MOVE_STATE_QUEUED 1     // Move is accepted, motors haven't started yet
+#define MOVE_STATE_RUNNING 2    // Motors are running
+#define MOVE_STATE_REJECTED 3   // Move was refused by the stepper library or motors didn't start
+
+// Tasks of loop() in priority order (see scheduler_tick())
+#define TASK_MOTION 0       // Hoop feed, main motor and job commands (runs in every tick)
+#define TASK_READ_AHEAD 1   // Reading of the job file into the command queue
+#define TASK_UI 2           // Menus (drawing into the screen buffer)
+#define TASK_LCD 3          // Writing of the changed characters to the LCD
+#define TASK_LOG 4          // Debug statistics
+#define TASK_COUNT 5
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    int32_t x;
+    int32_t y;
+    uint32_t value;
+} command_t;
+
+// Design information (stored in the index file on the card)
+typedef struct {
+    uint32_t stitch_count;
+    uint32_t jump_count;
+    uint16_t color_count;
+
+    // Bounding box (0.1 mm)
+    int16_t x_min, y_min, x_max, y_max;
+
+    // Estimated job duration without pauses (s, 0 - unknown)
+    uint32_t duration;
+} file_metadata_t;
+
 // Debug serial
 #ifdef DEBUG
 extern HardwareSerial* serial;
 #endif
 
+// Command queue
+void command_queue_clear(void);
+uint8_t command_queue_get_free();
+boolean command_queue_is_empty();
+command_t *command_queue_push();
+command_t *command_queue_front();
+command_t *command_queue_back();
+command_t *command_queue_get(uint8_t index);
+void command_queue_pop(void);
+
 // Encoder
 void encoder_setup(void);
 int32_t encoder_get_counter();
@@ -50,10 +117,23 @@ void encoder_reset_counter(void);
 void encoder_clear_button_flag(void);
 
 // Gcode-handler
-void gcode_cycle(void);
+boolean gcode_cycle();
+boolean gcode_start();
+void gcode_read_ahead(void);
+boolean gcode_read_metadata(file_metadata_t *metadata);
+boolean gcode_scan_start();
+void gcode_scan_step(void);
+boolean gcode_is_scanning();
+uint8_t gcode_get_scan_progress();
+boolean gcode_scan_finish(file_metadata_t *metadata);
+void gcode_set_duration(uint32_t duration);
+int32_t gcode_get_remaining_time();
+void gcode_queue_command(uint8_t type, uint8_t flags, int32_t x, int32_t y, uint32_t value);
 uint8_t gcode_get_tension();
 void gcode_set_tension(uint8_t tension);
 uint8_t gcode_get_progress();
+boolean gcode_get_progress_flag();
+void gcode_clear_progress_flag(void);
 uint8_t gcode_get_paused_code();
 void gcode_clear(void);
 void gcode_pause(void);
@@ -62,6 +142,8 @@ void gcode_stop(void);
 
 // LCD
 void lcd_setup(void);
+void lcd_flush(uint8_t cells);
+void lcd_flush_all(void);
 void lcd_print_error(const char *message);
 void lcd_print_error(const __FlashStringHelper *message);
 void lcd_append_file_top(void);
@@ -71,6 +153,9 @@ void lcd_print_cursor(uint8_t selector_cursor);
 void lcd_print_bottom_right_cursor(boolean is_cursor);
 void lcd_print_file_name(void);
 void lcd_print_pre_start(void);
+void lcd_print_metadata(file_metadata_t *metadata);
+void lcd_print_scan_progress(uint8_t percent);
+void lcd_print_duration(int32_t duration);
 void lcd_print_work(void);
 void lcd_print_progress(void);
 void lcd_print_tension(void);
@@ -87,52 +172,131 @@ void menu_pause(void);
 void menu_stop_confirmation(void);
 void menu_stop_file(void);
 void menu_pause_file(void);
+void menu_pause_file_error(const __FlashStringHelper *message);
 
 // Motors
 boolean motors_setup();
-float motors_get_x();
-float motors_get_y();
-void motors_set_speed_x(float speed_mm_s);
-void motors_set_speed_y(float speed_mm_s);
+int32_t motors_get_x();
+int32_t motors_get_y();
+void motors_set_speed_x(uint32_t speed_hz);
+void motors_set_speed_y(uint32_t speed_hz);
 void motors_set_speed_z(uint32_t speed_hz);
-void motors_set_acceleration_x(float acceleration_mm_s);
-void motors_set_acceleration_y(float acceleration_mm_s);
+void motors_set_acceleration_x(int32_t acceleration_steps_s);
+void motors_set_acceleration_y(int32_t acceleration_steps_s);
 void motors_set_acceleration_z(int32_t acceleration_steps_s);
-void motors_move_to_position(float *x, float *y);
+void motors_move_to_position(int32_t x, int32_t y);
+void motors_move_line(int32_t x, int32_t y, uint32_t distance, uint32_t speed, uint32_t acceleration,
+    uint32_t jerk, uint32_t exit_speed);
+void motors_update(void);
+int32_t motors_fixed_to_steps(int32_t position, int32_t steps_per_mm);
+int32_t motors_steps_to_fixed(int32_t steps, int32_t steps_per_mm);
 void motors_enable(void);
 void motors_disable(void);
 boolean is_motors_stopped();
+uint8_t motors_get_move_state(void);
+boolean is_motors_move_queued();
 void motors_stop(void);
 void motors_abort_and_reset(void);
 void motors_enable_z(void);
 void motors_disable_z(void);
 void motors_start_z(void);
+void motors_start_z_stitch(void);
+void motors_move_z_to(int32_t position);
 void motors_stop_z(void);
 boolean is_motor_z_stopped();
+int32_t motors_get_z_steps();
+int32_t motors_get_z_steps_at(uint32_t time);
+
+// OEB reader
+boolean oeb_reader_begin();
+boolean oeb_reader_read_ahead();
+boolean oeb_reader_read_metadata(file_metadata_t *metadata);
+
+// DST reader
+boolean dst_reader_begin();
+boolean dst_reader_read_ahead();
+boolean dst_reader_read_metadata(file_metadata_t *metadata);
 
 // Needle sensor
 void needle_sensor_setup(void);
+void needle_sensor_update(void);
+void needle_sensor_restart(void);
 boolean needle_sensor_get_interrupt_flag();
 void needle_sensor_clear_interrupt_flag(void);
+uint32_t needle_sensor_get_period();
+uint16_t needle_sensor_get_rpm();
+uint32_t needle_sensor_get_pulse(uint32_t *period);
+int32_t needle_sensor_get_steps_since_index();
+boolean needle_sensor_get_index_position(int32_t *position);
+int32_t needle_sensor_get_steps_per_revolution();
+int32_t needle_sensor_get_time_to_needle_up();
+uint16_t needle_sensor_get_missed_count();
+uint16_t needle_sensor_get_double_count();
+
+// Scheduler
+void scheduler_set_task(uint8_t task, boolean (*run)(void), uint16_t period);
+void scheduler_tick(boolean is_budgeted);
+void scheduler_reset_statistics(void);
+uint32_t scheduler_get_wcet(uint8_t task);
+uint32_t scheduler_get_skipped_count(uint8_t task);
 
 // SD card
 boolean sd_card_setup();
-void sd_card_count_files(void);
+void sd_card_build_index(void);
 uint32_t sd_card_get_number_of_files();
+boolean sd_card_select_file(uint32_t index);
 boolean sd_card_read_next_file();
 boolean sd_card_read_prev_file();
 char *sd_card_get_file_name();
+boolean sd_card_get_metadata(file_metadata_t *metadata);
+void sd_card_set_metadata(file_metadata_t *metadata);
+uint8_t sd_card_get_needle_speed();
+void sd_card_set_needle_speed(uint8_t percent);
 void sd_card_reset_files(void);
 void sd_card_file_rewind(void);
 boolean sd_card_check_selected_file();
-boolean sd_card_read_next_line();
-char *sd_card_get_buffer();
+char *sd_card_read_line(uint16_t *length);
+uint32_t sd_card_get_read_speed();
+int16_t sd_card_read_data(void *data, uint16_t size);
+uint8_t sd_card_get_file_type();
+uint32_t sd_card_get_file_size();
+uint32_t sd_card_get_file_position();
+boolean sd_card_file_seek(uint32_t position);
+
+// Speed governor
+void speed_governor_start(uint8_t percent);
+uint32_t speed_governor_apply(uint32_t speed);
+void speed_governor_stitch(void);
+void speed_governor_needle_up(boolean is_needle_running);
+void speed_governor_move_done(void);
+void speed_governor_stop(void);
+
+// Speed controller
+void speed_controller_setup(void);
+void speed_controller_update(void);
+void speed_controller_write_speed(uint8_t pwm);
+void speed_controller_set_speed(uint32_t speed_hz);
+void speed_controller_set_acceleration(int32_t acceleration_steps_s);
+void speed_controller_start(boolean is_single_stitch);
+void speed_controller_stop(void);
+boolean is_speed_controller_stopped();
 
 // Servo
 void servo_setup(void);
-void servo_set_tension(uint8_t tension);
+uint16_t servo_set_tension(uint8_t tension);
+uint16_t servo_get_move_time(uint8_t tension);
+uint16_t servo_get_tension_time(uint8_t tension_from, uint8_t tension_to);
+uint16_t servo_get_remaining_time();
 
 // Time converter
 time_t date_time_to_epoch(uint8_t hour, uint8_t minute, uint8_t second, uint8_t day, uint8_t month, uint16_t year);
 
+// Z stop table
+void z_stop_table_load(void);
+int32_t z_stop_table_get(uint32_t speed, uint32_t acceleration);
+void z_stop_table_learn(uint32_t speed, uint32_t acceleration, int32_t steps);
+
+// Fixed-point math
+uint16_t isqrt32(uint32_t value);
+
 #endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef DC_MOTOR_H
+#define DC_MOTOR_H
+
+// This module doesn't depend on Arduino, so it can also be built by the host tools (see tools/)
+#include <stdint.h>
+
+// Closed-loop speed control of a DC (universal) main motor, the needle sensor gives one pulse per revolution
+// PID gains are in 1/256 of PWM per rpm (P), per rpm*s (I) and per rpm/s (D)
+#define DC_MOTOR_GAIN_BITS 8
+
+// Integral term limit (1/256 of PWM)
+#define DC_MOTOR_INTEGRAL_MAX (255L << DC_MOTOR_GAIN_BITS)
+
+// Speed is re-estimated when the pulse is late by this many periods of the setpoint
+#define DC_MOTOR_STALL_PERIODS 2
+
+#define DC_MOTOR_STATE_STOPPED 0
+#define DC_MOTOR_STATE_RUNNING 1
+#define DC_MOTOR_STATE_PRE_BRAKE 2     // Single stitch runs at the positioning speed before the needle-up pulse
+#define DC_MOTOR_STATE_COASTING 3      // Power is off, waiting for standstill
+
+typedef struct {
+    // Gains, feed-forward (PWM that starts the motor, speed at full PWM), positioning speed (rpm),
+    // time at the positioning speed before the needle-up pulse and time from power off to standstill (ms)
+    uint16_t kp, ki, kd;
+    uint8_t pwm_min;
+    uint16_t rpm_max, rpm_positioning;
+    uint16_t pre_brake_time, coast_time;
+
+    uint8_t state;
+    bool is_single_stitch;
+
+    // Target speed (rpm), speed ramp (rpm/s) and ramped setpoint (1/1000 of rpm)
+    uint16_t rpm_target;
+    uint32_t ramp, setpoint;
+
+    // Last measured speed (rpm, 0 - unknown), error at the last pulse (rpm), integral and PID output (1/256 of PWM)
+    uint16_t rpm;
+    int32_t error, integral, output;
+    uint8_t pwm;
+
+    // Time of the last update, of the last speed sample, of the start and of the state change (ms)
+    uint32_t time_last, time_sample, time_start, time_state;
+
+    // Learned duration of a single stitch at the speed it was learned at (ms, 0 - unknown)
+    uint32_t stitch_time;
+    uint16_t stitch_rpm;
+} dc_motor_t;
+
+void dc_motor_reset(dc_motor_t *motor);
+void dc_motor_set_speed(dc_motor_t *motor, uint16_t rpm);
+void dc_motor_set_ramp(dc_motor_t *motor, uint32_t ramp);
+void dc_motor_start(dc_motor_t *motor, uint32_t time, bool is_single_stitch);
+void dc_motor_stop(dc_motor_t *motor, uint32_t time);
+void dc_motor_pulse(dc_motor_t *motor, uint32_t time, uint32_t period);
+uint8_t dc_motor_update(dc_motor_t *motor, uint32_t time);
+
+#endif
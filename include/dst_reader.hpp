@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef DST_READER_H
+#define DST_READER_H
+
+// Tajima .DST: 512-byte text header followed by 3-byte stitch records (0.1 mm units)
+#define DST_HEADER_SIZE 512
+#define DST_RECORD_SIZE 3
+
+// Label, stitch count, color count and extents (+X, -X, +Y, -Y) at the beginning of the header
+#define DST_HEADER_FIELDS_SIZE 74
+
+// Records are read from the file in chunks
+#define DST_RECORD_BUFFER_LENGTH 16
+
+// First stitch after a jump: progress, jump, pause, tension, dwell, move, 2 accelerations, stitch, trim pause
+#define DST_MAX_COMMANDS_PER_RECORD 10
+
+// 4 corners of the design and the origin
+#define DST_OUTLINE_POINTS 5
+
+// Pause codes used by OpenEmbroidery.py (M0 C..). Color changes are 1, 2, 3, ...
+#define DST_PAUSE_CODE_THREAD 100
+#define DST_PAUSE_CODE_TRIM 101
+
+#define DST_END_OF_DESIGN 0xF3
+
+uint8_t dst_records[DST_RECORD_BUFFER_LENGTH * DST_RECORD_SIZE];
+uint8_t dst_records_index, dst_records_count;
+uint32_t dst_record_number, dst_record_count;
+
+// Current position (0.1 mm, Y axis points down) and design extents from the header (+X, -X, +Y, -Y)
+int32_t dst_x, dst_y;
+int32_t dst_extents[4];
+uint8_t dst_outline_index;
+
+uint8_t dst_stitch_counter, dst_color_counter, dst_progress;
+boolean dst_is_thread_pulled_out, dst_is_tensioned, dst_is_finished;
+
+boolean dst_reader_read_header(char *fields);
+uint8_t *dst_reader_next_record();
+void dst_reader_decode_record(uint8_t *record, int32_t *dx, int32_t *dy);
+int32_t dst_reader_parse_field(char *fields, const char *label);
+void dst_reader_queue_outline(void);
+void dst_reader_queue_record(uint8_t *record);
+void dst_reader_set_tension(boolean is_tensioned);
+
+#endif
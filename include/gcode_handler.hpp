@@ -24,33 +24,122 @@
 
 #include <EEPROM.h>
 
+#include "gcode_parser.hpp"
+#include "job_estimate.hpp"
+
 #define CONDITION_IMMEDIATELY 0
 #define CONDITION_AFTER_MOVE 1
 #define CONDITION_AFTER_INTERRUPT 2
 #define CONDITION_AFTER_DWELL 3
+#define CONDITION_AFTER_STITCH 4
+#define CONDITION_AFTER_MOVE_QUEUED 5
+
+#if defined(JUNCTION_DEVIATION) && !defined(COORDINATED_MOVES)
+#error JUNCTION_DEVIATION requires COORDINATED_MOVES
+#endif
+#if defined(S_CURVE_MOVES) && !defined(COORDINATED_MOVES)
+#error S_CURVE_MOVES requires COORDINATED_MOVES
+#endif
 
 #define ACTION_NONE 0
 #define ACTION_STOP_MOTOR 1
 
-float x_new, y_new;
-float interpolation_x_d, interpolation_y_d, interpolation_distance, interpolation_x, interpolation_y;
-uint32_t speed_xy, speed_z, acceleration_x, acceleration_y;
-int command;
+// Value is not known yet (COMMAND_OPTIMIZER)
+#define OPTIMIZER_UNKNOWN 0xFF
+
+// Positions and distances are in hundredths of mm
+int32_t x_new, y_new, x_current, y_current;
+uint32_t interpolation_x_d, interpolation_y_d, interpolation_distance;
+uint32_t speed_z, acceleration_x, acceleration_y, acceleration_z, jerk_xy;
+
+// Read-ahead state (position after all queued moves and modal values)
+gcode_words_t words;
+int32_t x_queued, y_queued;
+uint32_t speed_xy_queued, acceleration_x_queued, acceleration_y_queued;
+uint8_t progress_queued;
+boolean is_end_of_file;
 
 unsigned long dwell_timer, dwell_delay;
 
+// Last queued values (COMMAND_OPTIMIZER): end and start of the last move, modal values, dropped commands
+int32_t optimizer_x, optimizer_y, optimizer_x_start, optimizer_y_start;
+uint32_t optimizer_acceleration_x, optimizer_acceleration_y, optimizer_acceleration_z, optimizer_jerk;
+uint8_t optimizer_tension, optimizer_progress;
+boolean is_optimizer_tension_dropped;
+uint32_t optimizer_dropped_count;
+
+// Needle speed of the previous stitch (ADAPTIVE_NEEDLE_SPEED, 0 - main motor was stopped)
+uint32_t needle_speed_last;
+
+// Tension change issued during the current move (TENSION_SCHEDULING): tension (0 to 100) and time to write it (ms)
+boolean is_tension_scheduled;
+uint8_t scheduled_tension;
+unsigned long tension_schedule_time;
+
+// Tension after the last adapted tension change (M42 - 1, M41 - 0), modeled servo move time of it (ms) and whether it
+// was the last adapted command
+uint8_t adapt_tension;
+uint16_t adapt_tension_time;
+boolean is_adapt_after_tension;
+
+// Estimate of the executed commands (or of the whole file during the pre-scan)
+job_estimate_t job_estimate;
+
+// Estimated job duration (ms, 0 - unknown)
+uint32_t job_duration;
+
+// Pre-scan of the selected file (JOB_PRE_SCAN): state, start time and time spent in the scan slices (ms)
+#define SCAN_STATE_NONE 0
+#define SCAN_STATE_RUNNING 1
+#define SCAN_STATE_DONE 2
+
+uint8_t scan_state;
+unsigned long scan_timer, scan_busy_time;
+
 uint8_t next_line_condition;
 uint8_t action_after_needle_interrupt;
 boolean z_move_until_needle_interrupt;
 
 uint8_t tension_;
 uint8_t progress;
+
+// Progress changed since the LCD was updated (it's redrawn by the UI task, not by the command)
+boolean is_progress_changed;
 uint8_t paused_code;
 
 boolean is_tensioned;
 
-void calculate_interpolation(void);
-float gcode_parse_code(char code, float default_value);
+// Main motor keeps running between stitches (CONTINUOUS_NEEDLE)
+boolean is_needle_running;
+
+// Z stop started early at z_stop_position (Z_STOP_COMPENSATION)
+boolean is_z_stop_early;
+int32_t z_stop_position;
+
+// Z stop being measured: start position, speed and acceleration
+boolean is_z_stop_measured;
+int32_t z_stop_start;
+uint32_t z_stop_speed, z_stop_acceleration;
+
+boolean gcode_open_file();
+boolean gcode_check_condition();
+void gcode_reject_move(void);
+boolean gcode_optimize_command(uint8_t type, int32_t x, int32_t y, uint32_t value);
+void gcode_optimizer_reset(void);
+void gcode_execute(command_t *command);
+void gcode_estimate(command_t *command);
+boolean gcode_keeps_needle_running(command_t *command);
+void gcode_adapt_command(command_t *command);
+void gcode_schedule_tension(void);
+uint32_t gcode_get_adaptive_needle_speed(void);
+uint32_t gcode_get_junction_speed(command_t *command, int32_t x, int32_t y, uint32_t acceleration);
+void gcode_brake_on_next_move(void);
+int32_t gcode_get_needle_up_position();
+void gcode_prepare_z_stop(void);
+void gcode_stop_z_measured(void);
+boolean calculate_interpolation(void);
+int32_t gcode_parse_code(char code, int32_t default_value);
+int32_t gcode_parse_fixed(char code, int32_t default_value);
 
 #endif
 
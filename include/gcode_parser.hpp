@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef GCODE_PARSER_H
+#define GCODE_PARSER_H
+
+// This module doesn't depend on Arduino, so it can also be built by the host tools (see tools/)
+#include <stdint.h>
+
+// Number of possible G-code letters (A to Z)
+#define GCODE_LETTERS 26
+
+// Values are stored as fixed-point numbers (ex. X12.34 -> 1234, G1 -> 100)
+#define GCODE_FIXED_SCALE 100
+
+// Presence bit of the letter inside gcode_words_t.mask
+#define GCODE_WORD_BIT(letter) ((uint32_t)1 << ((letter) - 'A'))
+
+// All words of one G-code line (ex. G1 X12.34 Y-5.67 F150)
+typedef struct {
+    // Bit (letter - 'A') is set if the letter is present in the line
+    uint32_t mask;
+
+    // Value of each letter in hundredths (valid only if the letter bit is set)
+    int32_t value[GCODE_LETTERS];
+} gcode_words_t;
+
+void gcode_parser_tokenize(const char *line, gcode_words_t *words);
+int32_t gcode_parser_get(const gcode_words_t *words, char letter, int32_t default_value);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef JOB_ESTIMATE_H
+#define JOB_ESTIMATE_H
+
+// This module doesn't depend on Arduino, so it can also be built by the host tools (see tools/)
+#include <stdint.h>
+
+// Paused codes below this value are color changes (100 and above are thread insertion, trim, etc.)
+#define JOB_ESTIMATE_COLOR_CODE_END 100
+
+// Lower accelerations are counted as this one (mm/s^2)
+#define JOB_ESTIMATE_ACCELERATION_MIN 10
+
+// Statistics and duration of the job, accumulated command by command
+// Positions are in hundredths of mm (same as in the command queue)
+typedef struct {
+    uint32_t stitch_count;
+    uint32_t jump_count;
+    uint16_t color_count;
+
+    // Bounding box of all move targets
+    int32_t x_min, y_min, x_max, y_max;
+
+    // Estimated duration of moves, stitches and dwells (ms, pauses are not counted)
+    uint32_t duration;
+
+    // Estimated duration of the last move, stitch or dwell (ms)
+    uint32_t last_duration;
+
+    // Length of the last move (hundredths of mm)
+    uint32_t move_distance;
+
+    // Machine state
+    int32_t x, y;
+    uint32_t acceleration_x, acceleration_y, acceleration_z;
+    uint32_t steps_per_revolution;
+
+    // Jerk of X and Y (mm/s^3, 0 - constant acceleration)
+    uint32_t jerk;
+
+    // Speed at the end of the last move, the next move starts with it (mm/s)
+    uint32_t exit_speed;
+
+    // Last move is not followed by a stitch yet
+    bool is_move_pending;
+
+    // 640000 / acceleration for the last move acceleration
+    uint32_t move_acceleration, move_factor;
+
+    // Duration of one stitch for the last needle speed and acceleration
+    uint32_t stitch_speed, stitch_acceleration, stitch_duration;
+} job_estimate_t;
+
+void job_estimate_reset(job_estimate_t *estimate, int32_t x, int32_t y, uint32_t acceleration_x,
+                        uint32_t acceleration_y, uint32_t acceleration_z, uint32_t steps_per_revolution);
+void job_estimate_move(job_estimate_t *estimate, int32_t x, int32_t y, uint32_t speed, uint32_t exit_speed);
+uint32_t job_estimate_move_duration(job_estimate_t *estimate, uint32_t distance, uint32_t speed,
+                                    uint32_t acceleration, uint32_t entry_speed, uint32_t exit_speed);
+void job_estimate_dwell(job_estimate_t *estimate, uint32_t delay);
+void job_estimate_pause(job_estimate_t *estimate, uint8_t paused_code);
+void job_estimate_stitch(job_estimate_t *estimate, uint32_t speed);
+void job_estimate_acceleration(job_estimate_t *estimate, uint32_t acceleration_x, uint32_t acceleration_y,
+                               uint32_t acceleration_z);
+void job_estimate_jerk(job_estimate_t *estimate, uint32_t jerk);
+void job_estimate_finish(job_estimate_t *estimate);
+
+// Fixed-point math (src/fixed_math.cpp)
+uint16_t isqrt32(uint32_t value);
+
+#endif
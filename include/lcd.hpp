@@ -24,7 +24,35 @@
 
 #include <LCD_I2C.h>
 
-LCD_I2C lcd(0x27, 20, 4);
+// Size of the screen
+#define LCD_COLUMNS 20
+#define LCD_ROWS 4
+#define LCD_CELLS (LCD_COLUMNS * LCD_ROWS)
+
+// Position of the LCD cursor is not known
+#define LCD_CURSOR_UNKNOWN 0xFF
+
+LCD_I2C lcd_device(0x27, LCD_COLUMNS, LCD_ROWS);
+
+// Shadow of the screen: drawing only changes the RAM copy, lcd_flush() writes the changed cells to the LCD
+class lcd_buffer_t : public Print {
+public:
+    void clear(void);
+    void setCursor(uint8_t column, uint8_t row);
+    size_t write(uint8_t character) override;
+    using Print::write;
+};
+
+lcd_buffer_t lcd;
+
+// Drawn screen, screen shown on the LCD and cursor of the drawing
+char lcd_screen[LCD_ROWS][LCD_COLUMNS];
+char lcd_shown[LCD_ROWS][LCD_COLUMNS];
+uint8_t lcd_column, lcd_row;
+
+// Next cell checked by the flush, cell of the LCD cursor and whether any cell may differ from the LCD
+uint8_t lcd_flush_index, lcd_cursor_index;
+boolean is_lcd_changed;
 
 char selector_lines[4][20];
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef LINE_RAMP_H
+#define LINE_RAMP_H
+
+// This module doesn't depend on Arduino, so it can also be built by the host tools (see tools/)
+#include <stdint.h>
+
+// Speed ramp of the lead axis of coordinated moves, calculated slice by slice
+// Velocity, acceleration and jerk are in 1/65536 of step per slice (per slice^2, per slice^3)
+#define LINE_RAMP_FRACTION_BITS 16
+
+#define LINE_RAMP_PHASE_ACCELERATE 0
+#define LINE_RAMP_PHASE_COAST 1
+#define LINE_RAMP_PHASE_DECELERATE 2
+
+typedef struct {
+    uint8_t phase;
+
+    // Current, maximum and end speed
+    uint32_t velocity, velocity_max, velocity_exit;
+
+    // Acceleration limit and jerk (0 - constant acceleration, trapezoidal ramp)
+    uint32_t acceleration_max, jerk;
+
+    // Current acceleration (S-curve only, negative while decelerating)
+    int32_t acceleration;
+} line_ramp_t;
+
+void line_ramp_start(line_ramp_t *ramp, uint32_t velocity_entry, uint32_t velocity_max, uint32_t velocity_exit,
+                     uint32_t acceleration, uint32_t jerk);
+uint32_t line_ramp_next(line_ramp_t *ramp, uint32_t remaining);
+uint32_t line_ramp_brake_steps(line_ramp_t *ramp, uint32_t velocity_exit);
+
+// Fixed-point math (src/fixed_math.cpp)
+uint16_t isqrt32(uint32_t value);
+
+#endif
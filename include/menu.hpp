@@ -25,5 +25,14 @@
 int32_t menu_encoder_counter, menu_encoder_counter_temp;
 uint8_t selector_cursor, sub_menu_cursor;
 uint32_t file_index;
+file_metadata_t file_metadata;
+boolean is_file_metadata_known;
+
+// Shown progress of the file scan (JOB_PRE_SCAN)
+uint8_t scan_progress;
+
+// Error shown on the pause screen instead of the pause menu (since this time)
+boolean is_pause_error_shown;
+unsigned long pause_error_timer;
 
 #endif
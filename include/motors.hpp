@@ -24,6 +24,9 @@
 
 #include <FastAccelStepper.h>
 
+#include "gcode_parser.hpp"
+#include "line_ramp.hpp"
+
 FastAccelStepperEngine engine = FastAccelStepperEngine();
 FastAccelStepper *stepper_x = NULL;
 FastAccelStepper *stepper_y = NULL;
@@ -31,4 +34,54 @@ FastAccelStepper *stepper_z = NULL;
 
 int32_t new_position_x_steps, new_position_y_steps;
 
+// State of the last started move (MOVE_STATE_...) and time it was started (ms)
+uint8_t move_state;
+unsigned long move_start_time;
+
+// Move that doesn't start running in this time is rejected (ms)
+#define MOTORS_MOVE_START_TIMEOUT 100
+
+// Last values written to the motors (unchanged values are not written again)
+uint32_t motor_speed_x, motor_speed_y, motor_speed_z;
+int32_t motor_acceleration_x, motor_acceleration_y, motor_acceleration_z;
+
+// Coordinated move is generated in time slices, each slice is one queue entry per motor
+#define MOTORS_LINE_SLICES_PER_S 500
+#define MOTORS_LINE_SLICE_TICKS (TICKS_PER_S / MOTORS_LINE_SLICES_PER_S)
+
+// Speed limit (steps per slice of the lead axis, 32000 steps/s)
+#define MOTORS_LINE_MAX_STEPS_PER_SLICE 64
+
+// Acceleration limit (steps/s^2, keeps the conversion in 32 bits)
+#define MOTORS_LINE_MAX_ACCELERATION 262143
+
+// Jerk limit (mm/s^3, keeps the conversion in 32 bits)
+#define MOTORS_LINE_MAX_JERK 90000
+
+// Coordinated move: the axis with more steps leads, the other one follows it (Bresenham)
+FastAccelStepper *line_lead, *line_follower;
+boolean is_line_active;
+boolean is_line_lead_count_up, is_line_follower_count_up;
+
+// Steps of both axes, done and last steps of the lead axis, lead axis steps per mm of the line
+uint32_t line_steps_lead, line_steps_follower, line_done, line_end, line_steps_per_mm;
+int32_t line_error;
+
+// Speed ramp of the lead axis and steps of the slice (1/65536 of step)
+line_ramp_t line_ramp;
+uint32_t line_fraction;
+
+// Speed at the end of the queued move (mm/s, 0 - the move stops), the next move continues with it
+uint32_t line_exit_speed;
+
+// Ticks of the previous slice that are not used by the steps (X and Y)
+uint16_t line_carry_x, line_carry_y;
+uint16_t *line_carry_lead, *line_carry_follower;
+
+void motors_line_slice(void);
+boolean motors_line_queue(FastAccelStepper *stepper, uint8_t steps, boolean count_up, uint16_t ticks,
+    uint16_t *carry);
+void motors_line_reject(void);
+void motors_line_brake(void);
+
 #endif
@@ -22,8 +22,34 @@
 #ifndef NEEDLE_SENSOR_H
 #define NEEDLE_SENSOR_H
 
+#if (NEEDLE_SENSOR_PERIODS & (NEEDLE_SENSOR_PERIODS - 1)) != 0
+#error NEEDLE_SENSOR_PERIODS must be a power of 2
+#endif
+
 volatile boolean needle_interrupt_flag;
 
+// Time (micros) and Z motor position (steps) of the last pulse (needle index)
+volatile uint32_t needle_pulse_time;
+volatile int32_t needle_pulse_position_z;
+
+// Z motor position of the last pulse isn't read yet
+volatile boolean is_needle_position_pending;
+
+// Needle stopped since the last pulse (the next period isn't a revolution)
+volatile boolean is_needle_restarted;
+
+// Z motor steps between the last two pulses (measured steps per revolution)
+volatile int32_t needle_index_steps;
+
+// Ring of the last periods between pulses (us) and their sum
+volatile uint32_t needle_periods[NEEDLE_SENSOR_PERIODS];
+volatile uint32_t needle_periods_sum;
+volatile uint8_t needle_periods_head, needle_periods_count;
+
+// Pulse counters (diagnostics)
+volatile uint32_t needle_pulse_count;
+volatile uint16_t needle_missed_count, needle_double_count;
+
 void needle_sensor_callback(void);
 
 #endif
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * OpenEmbroidery binary stitch format (.OEB)
+ * Shared by the firmware reader and the host packer (tools/oeb_pack.cpp), so it doesn't depend on Arduino
+ *
+ * All numbers are little-endian. The file is a 32-byte header followed by 8-byte records
+ * (64 records per 512-byte sector, so records never cross sectors)
+ *
+ * Move record (flags without OEB_FLAG_CONTROL) is executed in this order:
+ *  1. OEB_FLAG_TRIM    - stop main motor (M5)
+ *  2. OEB_FLAG_PAUSE   - pause with paused code = code (M0 C..: color change, thread insertion, trim)
+ *  3. OEB_FLAG_TENSION - thread tension during the move (M42 if set, M41 if not). Applied only when it changes,
+ *                        followed by a dwell of header.tension_dwell ms (longer dwells after some changes
+ *                        are completed by OEB_CONTROL_DWELL records)
+ *  4. dx, dy           - move by dx, dy steps relative to the previous record (skipped if both are 0)
+ *                        with jump speed if OEB_FLAG_JUMP is set (G0) or stitch speed otherwise (G1)
+ *  5. OEB_FLAG_STITCH  - one needle stitch with speed = value steps/s (M3 S.. I1)
+ *
+ * Control record (flags == OEB_FLAG_CONTROL) changes a setting, code is one of OEB_CONTROL_...
+ * and the argument is (uint16_t)dx | (uint16_t)dy << 16
+ *
+ * Progress is calculated by the reader from the record index, M17 is issued at the start and M5, M18 at the end
+ */
+
+#ifndef OEB_FORMAT_H
+#define OEB_FORMAT_H
+
+#include <stdint.h>
+
+#define OEB_MAGIC "OEB1"
+#define OEB_MAGIC_LENGTH 4
+
+#define OEB_FLAG_JUMP 0x01
+#define OEB_FLAG_STITCH 0x02
+#define OEB_FLAG_TRIM 0x04
+#define OEB_FLAG_PAUSE 0x08
+#define OEB_FLAG_TENSION 0x10
+#define OEB_FLAG_CONTROL 0x80
+
+#define OEB_CONTROL_JUMP_SPEED 0        // mm/s
+#define OEB_CONTROL_STITCH_SPEED 1      // mm/s
+#define OEB_CONTROL_ACCELERATION_X 2    // mm/s^2
+#define OEB_CONTROL_ACCELERATION_Y 3    // mm/s^2
+#define OEB_CONTROL_ACCELERATION_Z 4    // steps/s^2
+#define OEB_CONTROL_DWELL 5             // ms (G4)
+
+typedef struct {
+    // OEB_MAGIC (without null-terminator)
+    char magic[OEB_MAGIC_LENGTH];
+
+    // sizeof(oeb_header_t) and sizeof(oeb_record_t)
+    uint16_t header_size;
+    uint16_t record_size;
+
+    // Steps per mm the file was packed with (must match STEPS_PER_MM_X and STEPS_PER_MM_Y)
+    uint16_t steps_per_mm_x;
+    uint16_t steps_per_mm_y;
+
+    // Number of records, stitches and colors
+    uint32_t record_count;
+    uint32_t stitch_count;
+    uint16_t color_count;
+
+    // Delay after each tension change (ms), the shortest one in the design
+    uint16_t tension_dwell;
+
+    // Bounding box of all move end points (steps, 0 if there are no moves)
+    int16_t x_min, y_min, x_max, y_max;
+} oeb_header_t;
+
+typedef struct {
+    uint8_t flags;
+    uint8_t code;
+    int16_t dx;
+    int16_t dy;
+    uint16_t value;
+} oeb_record_t;
+
+#endif
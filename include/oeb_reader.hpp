@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef OEB_READER_H
+#define OEB_READER_H
+
+#include "oeb_format.hpp"
+
+// TRIM, PAUSE, TENSION + DWELL, MOVE, STITCH and PROGRESS
+#define OEB_MAX_COMMANDS_PER_RECORD 7
+
+// Records are read from the file in chunks
+#define OEB_RECORD_BUFFER_LENGTH 8
+
+oeb_header_t oeb_header;
+oeb_record_t oeb_records[OEB_RECORD_BUFFER_LENGTH];
+uint8_t oeb_records_index, oeb_records_count;
+uint32_t oeb_record_number;
+
+// Current position (steps) and settings
+int32_t oeb_x, oeb_y;
+uint32_t oeb_jump_speed, oeb_stitch_speed, oeb_acceleration_x, oeb_acceleration_y, oeb_acceleration_z;
+boolean oeb_is_tensioned;
+uint8_t oeb_progress;
+boolean oeb_is_finished;
+
+boolean oeb_reader_read_header();
+oeb_record_t *oeb_reader_next_record();
+void oeb_reader_queue_record(oeb_record_t *record);
+void oeb_reader_queue_control(oeb_record_t *record);
+
+#endif
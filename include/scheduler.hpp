@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+typedef struct {
+    // Task function (returns true if lower priority tasks should wait for the next tick), NULL - no task
+    boolean (*run)(void);
+
+    // Time between runs (ms, 0 - every tick) and start of the last run
+    uint16_t period;
+    unsigned long last_run;
+
+    // Worst-case execution time (us) and number of runs held back by the tick budget
+    uint32_t wcet;
+    uint32_t skipped_count;
+} scheduler_task_t;
+
+scheduler_task_t scheduler_tasks[TASK_COUNT];
+
+// Statistics were reset by the running task (its own run is not measured)
+boolean is_scheduler_reset;
+
+#endif
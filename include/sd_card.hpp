@@ -42,19 +42,91 @@ typedef FsFile file_t;
 
 FsFile dir;
 FsFile file, selected_file;
-time_t file_time_current, file_time_prev, file_time_max_temp, file_time_min_temp;
-
 uint16_t pdate, ptime;
 
-boolean file_name_valid;
-
 char file_name_temp[MAX_FILE_NAME_LENGTH];
 char file_name[19];
 
-char buffer[MAX_GCODE_LINE_LENGTH];
+// G-code is read by whole sectors
+#define SD_BLOCK_SIZE 512
+
+#if SD_INDEX_MAX_FILES * 4 > 2 * SD_BLOCK_SIZE
+#error SD_INDEX_MAX_FILES must be at most 256 (modify times are sorted in the stream buffer)
+#endif
+
+// Two sectors, so the line that crosses the sector boundary stays contiguous (+1 for null-terminator).
+// The buffer also holds modify times of the files while the index is built (at startup, before any file is read)
+static union {
+    char stream_buffer[2 * SD_BLOCK_SIZE + 1];
+    uint32_t index_date_times[SD_INDEX_MAX_FILES];
+};
+uint16_t stream_position, stream_length;
+boolean stream_is_end_of_file, stream_is_skipping_line;
+
+// Contiguous file is read by raw sectors starting from stream_sector_first
+boolean stream_is_contiguous, stream_is_raw_reading;
+uint32_t stream_sector_first, stream_file_position, stream_file_size;
+
+// Statistics of the reading (bytes and microseconds spent in read calls)
+uint32_t stream_bytes, stream_time;
 
 uint32_t number_of_files;
 
+// Sorted file index (newest first): entry index in root directory
+uint16_t index_dir_indexes[SD_INDEX_MAX_FILES];
+int32_t index_cursor;
+
+// Index file in the root of the card (file list in the same order and metadata of the designs)
+#define SD_INDEX_FILE_NAME "OEINDEX.BIN"
+#define SD_INDEX_FILE_SHORT_NAME "OEINDEX BIN"
+#define SD_INDEX_MAGIC "OEI1"
+#define SD_INDEX_MAGIC_LENGTH 4
+
+// Metadata of the entry is known
+#define SD_INDEX_FLAG_METADATA 0x01
+
+// FAT directory entry
+#define SD_DIR_ENTRY_SIZE 32
+#define SD_DIR_ENTRY_DELETED 0xE5
+#define SD_DIR_ATTRIBUTE_VOLUME_ID 0x08
+
+typedef struct {
+    char magic[SD_INDEX_MAGIC_LENGTH];
+    uint16_t entry_size;
+    uint16_t entry_count;
+
+    // Root directory when the index was written (entry count and checksum of names, sizes and modify times)
+    uint16_t root_entry_count;
+    uint16_t reserved;
+    uint32_t root_checksum;
+} sd_index_header_t;
+
+typedef struct {
+    char name[sizeof(file_name) + 1];
+    uint32_t size;
+    uint32_t date_time;
+    uint16_t dir_index;
+    uint8_t flags;
+
+    // Needle speed settled by SPEED_GOVERNOR (%, 0 - not tuned yet)
+    uint8_t needle_speed;
+    file_metadata_t metadata;
+} sd_index_file_entry_t;
+
+FsFile index_file;
+boolean is_index_file_valid;
+
+uint8_t file_type_temp, selected_file_type;
+
+boolean file_name_ends_with(const char *extension);
 boolean is_gcode();
+void sd_card_read_block(void);
+int16_t sd_card_read_raw_block(char *destination);
+void sd_card_stream_stop(void);
+boolean sd_card_root_signature(uint16_t *entry_count, uint32_t *checksum);
+uint32_t sd_card_checksum(uint32_t checksum, const uint8_t *data, uint8_t size);
+boolean sd_card_index_load(uint16_t root_entry_count, uint32_t root_checksum);
+void sd_card_index_save(uint16_t root_entry_count, uint32_t root_checksum);
+boolean sd_card_index_open_entry(oflag_t oflag, sd_index_file_entry_t *entry);
 
 #endif
@@ -25,6 +25,12 @@
 #include <ServoTimer2.h>
 
 ServoTimer2 servo;
+
+// Last written pulse (us, 0 - nothing written yet) and time when the servo finishes the move to it (ms)
 uint16_t servo_pulse;
+unsigned long servo_ready_time;
+
+uint16_t servo_get_pulse(uint8_t tension);
+uint16_t servo_get_slew_time(uint16_t pulse_from, uint16_t pulse_to);
 
 #endif
@@ -22,6 +22,20 @@
 #ifndef SPEED_CONTROLLER_H
 #define SPEED_CONTROLLER_H
 
+#include "dc_motor.hpp"
+
+#if defined(DC_MAIN_MOTOR) && defined(Z_STOP_COMPENSATION)
+#error DC_MAIN_MOTOR requires Z_STOP_COMPENSATION to be commented in config.hpp
+#endif
+#if defined(DC_MAIN_MOTOR) && defined(Z_POSITION_STITCH)
+#error DC_MAIN_MOTOR requires Z_POSITION_STITCH to be commented in config.hpp
+#endif
+
+dc_motor_t dc_motor;
+
+// Needle pulses handled by the control and the last written PWM
+uint32_t speed_controller_pulse_count;
+uint8_t speed_controller_pwm;
 
 
 #endif
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef SPEED_GOVERNOR_H
+#define SPEED_GOVERNOR_H
+
+#if SPEED_GOVERNOR_MAX_PERCENT > 250 || SPEED_GOVERNOR_MIN_PERCENT == 0
+#error SPEED_GOVERNOR_MIN_PERCENT and SPEED_GOVERNOR_MAX_PERCENT must be from 1 to 250
+#endif
+
+// Speed of stitches, the highest speed that is tried again and the speed stored for the design (%, 0 - not tuned)
+uint8_t governor_percent, governor_ceiling, governor_stored;
+boolean is_governor_tuned;
+
+// Current window: stitches, late stitches and needle pulses missed while the needle kept running
+uint8_t governor_stitches, governor_late;
+uint16_t governor_missed;
+
+// Missed pulse counter of the needle sensor at the last needle-up
+uint16_t governor_missed_count;
+
+// Needle-up time of the last stitch (us), the move after it is timed if the needle keeps running
+uint32_t governor_needle_up_time;
+boolean is_governor_move_timed;
+
+void speed_governor_decide(void);
+
+#endif
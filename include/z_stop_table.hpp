@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef Z_STOP_TABLE_H
+#define Z_STOP_TABLE_H
+
+#include <EEPROM.h>
+
+// EEPROM layout: magic, table size, entries (address 0 is the thread tension)
+#define Z_STOP_TABLE_EEPROM_ADDRESS 16
+#define Z_STOP_TABLE_MAGIC 0x5A
+
+// Stored steps are updated when the learned value differs by this number of steps (saves EEPROM writes)
+#define Z_STOP_TABLE_WRITE_STEPS 2
+
+typedef struct {
+    // Z speed (steps/s) and acceleration (steps/s^2), speed 0 - free entry
+    uint16_t speed;
+    uint16_t acceleration;
+
+    // Steps from the stop command to standstill
+    uint16_t steps;
+} z_stop_entry_t;
+
+#ifdef Z_STOP_COMPENSATION
+z_stop_entry_t z_stop_table[Z_STOP_TABLE_SIZE];
+
+// Entry to replace when the table is full
+uint8_t z_stop_table_next;
+#endif
+
+int16_t z_stop_table_find(uint16_t speed, uint16_t acceleration);
+void z_stop_table_save_entry(uint8_t index);
+
+#endif
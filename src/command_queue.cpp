@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "config.hpp"
+#include "datatypes.hpp"
+#include "command_queue.hpp"
+
+/**
+ * @brief Removes all commands from the queue
+ * 
+ */
+void command_queue_clear(void) {
+    command_queue_head = 0;
+    command_queue_tail = 0;
+    command_queue_count = 0;
+}
+
+/**
+ * @brief Returns number of free entries
+ * 
+ * @return uint8_t - 0 to COMMAND_QUEUE_LENGTH
+ */
+uint8_t command_queue_get_free() {
+    return COMMAND_QUEUE_LENGTH - command_queue_count;
+}
+
+/**
+ * @brief Checks if there are no commands in the queue
+ * 
+ * @return boolean - true if the queue is empty
+ */
+boolean command_queue_is_empty() {
+    return command_queue_count == 0;
+}
+
+/**
+ * @brief Adds new entry to the end of the queue
+ * Attention! The queue must not be full (check command_queue_get_free() before)
+ * 
+ * @return command_t* - new entry to fill
+ */
+command_t *command_queue_push() {
+    command_t *command = &command_queue[command_queue_head];
+    command_queue_head = (command_queue_head + 1) & (COMMAND_QUEUE_LENGTH - 1);
+    command_queue_count++;
+    return command;
+}
+
+/**
+ * @brief Returns the oldest command
+ * Attention! The queue must not be empty
+ * 
+ * @return command_t* - next command to execute
+ */
+command_t *command_queue_front() {
+    return &command_queue[command_queue_tail];
+}
+
+/**
+ * @brief Returns the newest command
+ * 
+ * @return command_t* - the last added command or NULL if the queue is empty
+ */
+command_t *command_queue_back() {
+    if (command_queue_count == 0)
+        return NULL;
+    return &command_queue[(command_queue_head - 1) & (COMMAND_QUEUE_LENGTH - 1)];
+}
+
+/**
+ * @brief Returns queued command without removing it (look-ahead)
+ * 
+ * @param index - 0 is the oldest command
+ * @return command_t* - command or NULL if there are not so many commands
+ */
+command_t *command_queue_get(uint8_t index) {
+    if (index >= command_queue_count)
+        return NULL;
+    return &command_queue[(command_queue_tail + index) & (COMMAND_QUEUE_LENGTH - 1)];
+}
+
+/**
+ * @brief Removes the oldest command
+ * 
+ */
+void command_queue_pop(void) {
+    if (command_queue_count == 0)
+        return;
+    command_queue_tail = (command_queue_tail + 1) & (COMMAND_QUEUE_LENGTH - 1);
+    command_queue_count--;
+}
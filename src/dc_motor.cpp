@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "dc_motor.hpp"
+
+/**
+ * @brief Runs the PID on a speed sample
+ * 
+ * @param motor - motor state
+ * @param rpm - measured speed
+ * @param period - time since the previous sample (ms)
+ * @param is_derivative - previous sample is valid
+ */
+static void dc_motor_pid(dc_motor_t *motor, uint16_t rpm, uint32_t period, bool is_derivative) {
+    int32_t error = (int32_t)(motor->setpoint / 1000) - rpm, derivative = 0;
+
+    if (is_derivative)
+        derivative = (error - motor->error) * 1000L / (int32_t)(period + 1);
+    motor->error = error;
+
+    // Anti-windup: no integration into the saturated side, the integral is limited
+    if (!(motor->pwm == 255 && error > 0) && !(motor->pwm == 0 && error < 0)) {
+        motor->integral += (int32_t)motor->ki * error / 100 * (int32_t)period / 10;
+        if (motor->integral > DC_MOTOR_INTEGRAL_MAX)
+            motor->integral = DC_MOTOR_INTEGRAL_MAX;
+        else if (motor->integral < -DC_MOTOR_INTEGRAL_MAX)
+            motor->integral = -DC_MOTOR_INTEGRAL_MAX;
+    }
+
+    motor->output = (int32_t)motor->kp * error + motor->integral + (int32_t)motor->kd * derivative;
+}
+
+/**
+ * @brief Stops the control (gains and feed-forward are kept, the motor has to be at standstill)
+ * 
+ * @param motor - motor state
+ */
+void dc_motor_reset(dc_motor_t *motor) {
+    motor->state = DC_MOTOR_STATE_STOPPED;
+    motor->is_single_stitch = false;
+    motor->setpoint = 0;
+    motor->rpm = 0;
+    motor->error = 0;
+    motor->integral = 0;
+    motor->output = 0;
+    motor->pwm = 0;
+    motor->stitch_time = 0;
+    motor->stitch_rpm = 0;
+}
+
+/**
+ * @brief Sets target speed (the setpoint follows it with the ramp)
+ * 
+ * @param motor - motor state
+ * @param rpm - revolutions (stitches) per minute
+ */
+void dc_motor_set_speed(dc_motor_t *motor, uint16_t rpm) {
+    motor->rpm_target = rpm;
+}
+
+/**
+ * @brief Sets speed ramp of the setpoint
+ * 
+ * @param motor - motor state
+ * @param ramp - rpm/s (at least 1)
+ */
+void dc_motor_set_ramp(dc_motor_t *motor, uint32_t ramp) {
+    motor->ramp = ramp > 0 ? ramp : 1;
+}
+
+/**
+ * @brief Starts the motor (or continues if it is still running)
+ * A single stitch slows down to the positioning speed before the needle-up pulse and stops at it
+ * 
+ * @param motor - motor state
+ * @param time - ms
+ * @param is_single_stitch - stop at the next needle pulse
+ */
+void dc_motor_start(dc_motor_t *motor, uint32_t time, bool is_single_stitch) {
+    // Setpoint starts from the current speed, the integral (load) is kept from the last run
+    if (motor->state == DC_MOTOR_STATE_STOPPED) {
+        motor->setpoint = 0;
+        motor->rpm = 0;
+    }
+    else if (motor->state == DC_MOTOR_STATE_COASTING)
+        motor->setpoint = motor->rpm * 1000UL;
+    motor->error = 0;
+    motor->output = motor->integral;
+
+    // First estimate of the stitch duration: one revolution at the target speed plus half of the ramp
+    if (is_single_stitch && motor->rpm_target > 0 && (motor->stitch_time == 0
+                                                      || motor->stitch_rpm != motor->rpm_target)) {
+        motor->stitch_time = 60000UL / motor->rpm_target + motor->rpm_target * 500UL / motor->ramp;
+        motor->stitch_rpm = motor->rpm_target;
+    }
+
+    motor->state = DC_MOTOR_STATE_RUNNING;
+    motor->is_single_stitch = is_single_stitch;
+    motor->time_last = time;
+    motor->time_sample = time;
+    motor->time_start = time;
+    motor->time_state = time;
+}
+
+/**
+ * @brief Cuts the power, the motor coasts to standstill
+ * 
+ * @param motor - motor state
+ * @param time - ms
+ */
+void dc_motor_stop(dc_motor_t *motor, uint32_t time) {
+    if (motor->state != DC_MOTOR_STATE_RUNNING && motor->state != DC_MOTOR_STATE_PRE_BRAKE)
+        return;
+    motor->state = DC_MOTOR_STATE_COASTING;
+    motor->time_state = time;
+    motor->pwm = 0;
+}
+
+/**
+ * @brief Handles needle pulse: measures the speed and runs the PID (sampled once per revolution)
+ * 
+ * @param motor - motor state
+ * @param time - time of the pulse (ms)
+ * @param period - period of the last revolution (us, 0 - first pulse after the stop)
+ */
+void dc_motor_pulse(dc_motor_t *motor, uint32_t time, uint32_t period) {
+    uint32_t elapsed;
+    uint16_t rpm_last = motor->rpm;
+
+    motor->rpm = period > 0 ? 60000000UL / period : 0;
+    motor->time_sample = time;
+    if (motor->state != DC_MOTOR_STATE_RUNNING && motor->state != DC_MOTOR_STATE_PRE_BRAKE)
+        return;
+
+    // Single stitch ends at the needle-up pulse, its duration moves the pre-braking of the next one
+    if (motor->is_single_stitch) {
+        elapsed = time - motor->time_start;
+        motor->stitch_time = (3 * motor->stitch_time + elapsed) / 4;
+        dc_motor_stop(motor, time);
+        return;
+    }
+    if (motor->rpm > 0)
+        dc_motor_pid(motor, motor->rpm, period / 1000, rpm_last > 0);
+}
+
+/**
+ * @brief Ramps the setpoint and calculates PWM (feed-forward from the setpoint plus the PID output)
+ * 
+ * @param motor - motor state
+ * @param time - ms
+ * @return uint8_t - PWM (0 to 255)
+ */
+uint8_t dc_motor_update(dc_motor_t *motor, uint32_t time) {
+    uint32_t dt = time - motor->time_last, elapsed, step, target;
+    int32_t pwm;
+
+    motor->time_last = time;
+    switch (motor->state) {
+    case DC_MOTOR_STATE_COASTING:
+        if (time - motor->time_state >= motor->coast_time) {
+            motor->state = DC_MOTOR_STATE_STOPPED;
+            motor->rpm = 0;
+        }
+        return 0;
+
+    case DC_MOTOR_STATE_RUNNING:
+    case DC_MOTOR_STATE_PRE_BRAKE:
+        break;
+
+    default:
+        return 0;
+    }
+
+    // Single stitch slows down so that it spends pre_brake_time at the positioning speed
+    if (motor->state == DC_MOTOR_STATE_RUNNING && motor->is_single_stitch
+        && time - motor->time_start + motor->pre_brake_time >= motor->stitch_time) {
+        motor->state = DC_MOTOR_STATE_PRE_BRAKE;
+        motor->time_state = time;
+        motor->time_sample = time;
+    }
+
+    target = motor->rpm_target;
+    if (motor->state == DC_MOTOR_STATE_PRE_BRAKE && target > motor->rpm_positioning)
+        target = motor->rpm_positioning;
+    target *= 1000;
+
+    step = motor->ramp * dt;
+    if (motor->setpoint < target)
+        motor->setpoint = target - motor->setpoint > step ? motor->setpoint + step : target;
+    else
+        motor->setpoint = motor->setpoint - target > step ? motor->setpoint - step : target;
+
+    // Pulse is overdue (stall, the needle load holds the motor at the positioning speed): the speed is at most
+    // one revolution per elapsed time. Single stitch has no pulses, it is checked from the start of pre-braking
+    elapsed = time - motor->time_sample;
+    if ((motor->rpm > 0 || motor->state == DC_MOTOR_STATE_PRE_BRAKE) && motor->setpoint >= 1000 && elapsed > DC_MOTOR_STALL_PERIODS * 60000000UL / motor->setpoint) {
+        motor->rpm = 60000UL / elapsed;
+        dc_motor_pid(motor, motor->rpm, elapsed, false);
+        motor->time_sample = time;
+    }
+
+    pwm = motor->output >> DC_MOTOR_GAIN_BITS;
+    if (motor->setpoint > 0)
+        pwm += motor->pwm_min + motor->setpoint / 100 * (255 - motor->pwm_min) / (motor->rpm_max * 10UL);
+    motor->pwm = pwm < 0 ? 0 : pwm > 255 ? 255 : pwm;
+    return motor->pwm;
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "config.hpp"
+#include "datatypes.hpp"
+#include "dst_reader.hpp"
+
+/**
+ * @brief Reads header of the selected .DST file and resets reader
+ * Attention! The file must be rewound before
+ * 
+ * @return boolean - true if the header is valid
+ */
+boolean dst_reader_begin() {
+    char fields[DST_HEADER_FIELDS_SIZE + 1];
+
+    // Read and check header
+    if (!dst_reader_read_header(fields) || !sd_card_file_seek(DST_HEADER_SIZE))
+        return false;
+
+    // Reset records buffer
+    dst_records_index = 0;
+    dst_records_count = 0;
+    dst_record_number = 0;
+    dst_record_count = (sd_card_get_file_size() - DST_HEADER_SIZE) / DST_RECORD_SIZE;
+
+    // Reset position and state
+    dst_x = 0;
+    dst_y = 0;
+    dst_stitch_counter = 0;
+    dst_color_counter = 1;
+    dst_progress = 0;
+    dst_is_thread_pulled_out = false;
+    dst_is_tensioned = false;
+    dst_is_finished = false;
+
+    // Skip outline if it's disabled or unknown
+    dst_outline_index = 0;
+#ifdef DST_OUTLINE_PREVIEW
+    if (dst_extents[0] < 0 || dst_extents[1] < 0 || dst_extents[2] < 0 || dst_extents[3] < 0)
+#endif
+        dst_outline_index = DST_OUTLINE_POINTS;
+
+    // M17, M73 P0, low accelerations and G4 P500
+    gcode_queue_command(COMMAND_ENABLE, 0, 0, 0, 0);
+    gcode_queue_command(COMMAND_PROGRESS, 0, 0, 0, 0);
+#ifdef ADAPTIVE_NEEDLE_SPEED
+    // Needle speed is chosen by the firmware, Z acceleration doesn't change with it
+    gcode_queue_command(COMMAND_ACCELERATION, 0, DST_ACCELERATION_X_MM_S, DST_ACCELERATION_Y_MM_S,
+        DST_ACCELERATION_Z_HIGH_HZ);
+#else
+    gcode_queue_command(COMMAND_ACCELERATION, 0, DST_ACCELERATION_X_MM_S, DST_ACCELERATION_Y_MM_S,
+        DST_ACCELERATION_Z_LOW_HZ);
+#endif
+    gcode_queue_command(COMMAND_DWELL, 0, 0, 0, DST_TENSION_DWELL_MS);
+    return true;
+}
+
+/**
+ * @brief Reads design information from the header of the selected .DST file
+ * Attention! The file must be rewound before
+ * 
+ * @param metadata - stitch count, color count and bounding box
+ * @return boolean - true if the header contains all fields
+ */
+boolean dst_reader_read_metadata(file_metadata_t *metadata) {
+    char fields[DST_HEADER_FIELDS_SIZE + 1];
+    int32_t stitch_count, color_changes;
+
+    if (!dst_reader_read_header(fields))
+        return false;
+
+    // Number of records (with jumps) and color changes
+    stitch_count = dst_reader_parse_field(fields, "ST:");
+    color_changes = dst_reader_parse_field(fields, "CO:");
+    if (stitch_count < 0 || color_changes < 0
+        || dst_extents[0] < 0 || dst_extents[1] < 0 || dst_extents[2] < 0 || dst_extents[3] < 0)
+        return false;
+
+    metadata->stitch_count = stitch_count;
+    metadata->color_count = color_changes + 1;
+
+    // Jumps are counted together with stitches, duration is unknown
+    metadata->jump_count = 0;
+    metadata->duration = 0;
+
+    // Y axis points down
+    metadata->x_min = -dst_extents[1];
+    metadata->y_min = -dst_extents[2];
+    metadata->x_max = dst_extents[0];
+    metadata->y_max = dst_extents[3];
+    return true;
+}
+
+/**
+ * @brief Reads and checks beginning of the header, gets design extents
+ * The file must have at least one record after the header (the progress is counted by records)
+ * 
+ * @param fields - buffer for DST_HEADER_FIELDS_SIZE + 1 bytes (null-terminated fields)
+ * @return boolean - true if the header is valid
+ */
+boolean dst_reader_read_header(char *fields) {
+    if (sd_card_get_file_size() < DST_HEADER_SIZE + DST_RECORD_SIZE
+        || sd_card_read_data(fields, DST_HEADER_FIELDS_SIZE) != DST_HEADER_FIELDS_SIZE
+        || memcmp(fields, "LA:", 3) != 0)
+        return false;
+    fields[DST_HEADER_FIELDS_SIZE] = 0;
+
+    // Design extents
+    dst_extents[0] = dst_reader_parse_field(fields, "+X:");
+    dst_extents[1] = dst_reader_parse_field(fields, "-X:");
+    dst_extents[2] = dst_reader_parse_field(fields, "+Y:");
+    dst_extents[3] = dst_reader_parse_field(fields, "-Y:");
+    return true;
+}
+
+/**
+ * @brief Converts next record into commands if there is enough space in the queue
+ * Commands are the same as G-code generated by OpenEmbroidery.py
+ * 
+ * @return boolean - false if the end of file is reached and all commands are queued
+ */
+boolean dst_reader_read_ahead() {
+    uint8_t *record;
+
+    // End of file
+    if (dst_is_finished)
+        return false;
+
+    // Wait for space in the queue
+    if (command_queue_get_free() < DST_MAX_COMMANDS_PER_RECORD)
+        return true;
+
+    // Outline and the first color
+    if (dst_outline_index <= DST_OUTLINE_POINTS) {
+        dst_reader_queue_outline();
+        return true;
+    }
+
+    // Update progress
+    if (dst_record_number * 100 / dst_record_count != dst_progress) {
+        dst_progress = dst_record_number * 100 / dst_record_count;
+        gcode_queue_command(COMMAND_PROGRESS, 0, 0, 0, dst_progress);
+    }
+
+    // No more records -> stop and disable motors (M5, M18)
+    record = dst_reader_next_record();
+    if (!record || record[2] == DST_END_OF_DESIGN) {
+        // End of design acts as a jump (stop and remove tension)
+        if (record) {
+            gcode_queue_command(COMMAND_STOP_Z, 0, 0, 0, 0);
+            dst_reader_set_tension(false);
+        }
+
+        gcode_queue_command(COMMAND_STOP_Z, 0, 0, 0, 0);
+        gcode_queue_command(COMMAND_DISABLE, 0, 0, 0, 0);
+        dst_is_finished = true;
+        return true;
+    }
+
+    dst_reader_queue_record(record);
+    dst_record_number++;
+    return true;
+}
+
+/**
+ * @brief Returns next record (reads next chunk of records from the file if needed)
+ * 
+ * @return uint8_t* - 3 bytes of the next record or NULL in case of end of file
+ */
+uint8_t *dst_reader_next_record() {
+    int16_t bytes_read;
+
+    // Read next chunk
+    if (dst_records_index >= dst_records_count) {
+        bytes_read = sd_card_read_data(dst_records, sizeof(dst_records));
+        if (bytes_read < DST_RECORD_SIZE)
+            return NULL;
+        dst_records_count = bytes_read / DST_RECORD_SIZE;
+        dst_records_index = 0;
+    }
+
+    return &dst_records[DST_RECORD_SIZE * dst_records_index++];
+}
+
+/**
+ * @brief Decodes X and Y offsets of the record (balanced ternary: 1, 3, 9, 27, 81)
+ * 
+ * @param record - 3 bytes of the record
+ * @param dx - X offset (0.1 mm)
+ * @param dy - Y offset (0.1 mm, Y axis points up)
+ */
+void dst_reader_decode_record(uint8_t *record, int32_t *dx, int32_t *dy) {
+    *dx = 0;
+    *dy = 0;
+    if (record[0] & 0x01) *dx += 1;
+    if (record[0] & 0x02) *dx -= 1;
+    if (record[0] & 0x04) *dx += 9;
+    if (record[0] & 0x08) *dx -= 9;
+    if (record[1] & 0x01) *dx += 3;
+    if (record[1] & 0x02) *dx -= 3;
+    if (record[1] & 0x04) *dx += 27;
+    if (record[1] & 0x08) *dx -= 27;
+    if (record[2] & 0x04) *dx += 81;
+    if (record[2] & 0x08) *dx -= 81;
+    if (record[0] & 0x80) *dy += 1;
+    if (record[0] & 0x40) *dy -= 1;
+    if (record[0] & 0x20) *dy += 9;
+    if (record[0] & 0x10) *dy -= 9;
+    if (record[1] & 0x80) *dy += 3;
+    if (record[1] & 0x40) *dy -= 3;
+    if (record[1] & 0x20) *dy += 27;
+    if (record[1] & 0x10) *dy -= 27;
+    if (record[2] & 0x20) *dy += 81;
+    if (record[2] & 0x10) *dy -= 81;
+}
+
+/**
+ * @brief Finds numeric field of the header
+ * 
+ * @param fields - null-terminated beginning of the header
+ * @param label - 3-char label of the field (for example "+X:")
+ * @return int32_t - value of the field or -1 if not found
+ */
+int32_t dst_reader_parse_field(char *fields, const char *label) {
+    char *field = strstr(fields, label);
+    return field ? atol(field + 3) : -1;
+}
+
+/**
+ * @brief Moves to the next point of the design outline, after the last one pauses for the first color (M0 C1)
+ * 
+ */
+void dst_reader_queue_outline(void) {
+    // Corners of the design: (x_min, y_min), (x_min, y_max), (x_max, y_max), (x_max, y_min) and the origin
+    int32_t x = 0, y = 0;
+
+    switch (dst_outline_index)
+    {
+    case 0:
+    case 1:
+        x = -dst_extents[1];
+        y = dst_outline_index == 0 ? -dst_extents[2] : dst_extents[3];
+        break;
+
+    case 2:
+    case 3:
+        x = dst_extents[0];
+        y = dst_outline_index == 3 ? -dst_extents[2] : dst_extents[3];
+        break;
+
+    case DST_OUTLINE_POINTS:
+        gcode_queue_command(COMMAND_PAUSE, 0, 0, 0, dst_color_counter);
+        dst_outline_index++;
+        return;
+
+    default:
+        break;
+    }
+
+    // 0.1 mm -> 0.01 mm, wait longer at the last corner
+    gcode_queue_command(COMMAND_MOVE, 0, x * 10, y * 10, DST_JUMP_SPEED_MM_S);
+    gcode_queue_command(COMMAND_DWELL, 0, 0, 0, dst_outline_index == 3 ? 2 * DST_TENSION_DWELL_MS : DST_TENSION_DWELL_MS);
+    dst_outline_index++;
+}
+
+/**
+ * @brief Converts stitch, jump or color change record into commands
+ * 
+ * @param record - 3 bytes of the record
+ */
+void dst_reader_queue_record(uint8_t *record) {
+    int32_t dx, dy;
+
+    dst_reader_decode_record(record, &dx, &dy);
+    dst_x += dx;
+    dst_y -= dy;
+
+    // Jump or color change -> stop main motor and remove tension
+    if (record[2] & 0x80) {
+        dst_stitch_counter = 0;
+        gcode_queue_command(COMMAND_STOP_Z, 0, 0, 0, 0);
+        dst_reader_set_tension(false);
+
+        // Color change -> pause and pull out the new thread after the next jump
+        if ((record[2] & 0xC3) == 0xC3) {
+            dst_color_counter++;
+            gcode_queue_command(COMMAND_PAUSE, 0, 0, 0, dst_color_counter);
+            dst_is_thread_pulled_out = false;
+        }
+
+        gcode_queue_command(COMMAND_MOVE, 0, dst_x * 10, dst_y * 10, DST_JUMP_SPEED_MM_S);
+        return;
+    }
+
+    // First stitch of the color -> jump to it and pause to insert the thread
+    if (!dst_is_thread_pulled_out) {
+        gcode_queue_command(COMMAND_MOVE, 0, dst_x * 10, dst_y * 10, DST_JUMP_SPEED_MM_S);
+        dst_reader_set_tension(false);
+        gcode_queue_command(COMMAND_PAUSE, 0, 0, 0, DST_PAUSE_CODE_THREAD);
+        dst_is_thread_pulled_out = true;
+        dst_is_tensioned = false;
+    }
+
+    // Stitch
+    dst_reader_set_tension(true);
+    gcode_queue_command(COMMAND_MOVE, 0, dst_x * 10, dst_y * 10, DST_STITCH_SPEED_MM_S);
+
+    // Low speed after the jump, then high speed (ADAPTIVE_NEEDLE_SPEED replaces the speed with its own)
+#ifndef ADAPTIVE_NEEDLE_SPEED
+    if (dst_stitch_counter == 0)
+        gcode_queue_command(COMMAND_ACCELERATION, 0, DST_ACCELERATION_X_MM_S, DST_ACCELERATION_Y_MM_S,
+            DST_ACCELERATION_Z_LOW_HZ);
+    if (dst_stitch_counter == DST_LOW_SPEED_STITCHES)
+        gcode_queue_command(COMMAND_ACCELERATION, 0, DST_ACCELERATION_X_MM_S, DST_ACCELERATION_Y_MM_S,
+            DST_ACCELERATION_Z_HIGH_HZ);
+#endif
+    gcode_queue_command(COMMAND_START_Z, COMMAND_FLAG_UNTIL_INTERRUPT, 0, 0,
+        dst_stitch_counter < DST_LOW_SPEED_STITCHES ? DST_NEEDLE_LOW_SPEED_HZ : DST_NEEDLE_HIGH_SPEED_HZ);
+
+    if (dst_stitch_counter <= DST_LOW_SPEED_STITCHES) {
+        dst_stitch_counter++;
+
+#ifdef DST_TRIM_PAUSE
+        // Pause to trim the thread tail
+        if (dst_stitch_counter == DST_LOW_SPEED_STITCHES)
+            gcode_queue_command(COMMAND_PAUSE, 0, 0, 0, DST_PAUSE_CODE_TRIM);
+#endif
+    }
+}
+
+/**
+ * @brief Changes thread tension (M41 / M42) and waits for the servo
+ * 
+ * @param is_tensioned - true to set high tension
+ */
+void dst_reader_set_tension(boolean is_tensioned) {
+    if (is_tensioned == dst_is_tensioned)
+        return;
+
+    dst_is_tensioned = is_tensioned;
+    gcode_queue_command(COMMAND_TENSION, 0, 0, 0, is_tensioned);
+    gcode_queue_command(COMMAND_DWELL, 0, 0, 0, DST_TENSION_DWELL_MS);
+}
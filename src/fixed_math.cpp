@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// This module doesn't depend on Arduino, so it can also be built by the host tools (see tools/)
+#include <stdint.h>
+
+/**
+ * @brief Calculates integer square root (digit-by-digit, without floats)
+ * 
+ * @param value - 0 to UINT32_MAX
+ * @return uint16_t - floor(sqrt(value))
+ */
+uint16_t isqrt32(uint32_t value) {
+    uint32_t result = 0;
+    uint32_t bit = (uint32_t)1 << 30;
+
+    // Find the highest power of 4 <= value
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        }
+        else
+            result >>= 1;
+        bit >>= 2;
+    }
+
+    return (uint16_t)result;
+}
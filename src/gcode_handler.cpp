@@ -23,222 +23,1283 @@
 #include "datatypes.hpp"
 #include "gcode_handler.hpp"
 
+/**
+ * @brief Executes the next command once the current one is finished (motion task)
+ * The file is read ahead by the read-ahead task, here only if the queue is empty
+ * 
+ * @return boolean - true if a command was executed (the next one may be ready already)
+ */
+boolean gcode_cycle() {
+#ifdef TENSION_SCHEDULING
+    // Tension change of the next command (the servo finishes with the current move)
+    if (is_tension_scheduled && (long)(millis() - tension_schedule_time) >= 0) {
+        servo_set_tension(scheduled_tension);
+        is_tension_scheduled = false;
+    }
+#endif
+
+    // Wait for the current command to finish
+    if (!gcode_check_condition())
+        return false;
+
+#ifdef SPEED_GOVERNOR
+    // Needle sync of the finished command
+    if (next_line_condition == CONDITION_AFTER_INTERRUPT)
+        speed_governor_needle_up(is_needle_running);
+    else if (next_line_condition == CONDITION_AFTER_MOVE)
+        speed_governor_move_done();
+#endif
+
+    // Reset needle interrupt flag
+    needle_sensor_clear_interrupt_flag();
+
+    // Reset next command condition
+    next_line_condition = CONDITION_IMMEDIATELY;
+
+    // Clear interrupt action
+    action_after_needle_interrupt = ACTION_NONE;
 
-void gcode_cycle(void) {
+    // Reset delay
+    dwell_delay = 0;
+
+    // Reset Dwell timer
+    dwell_timer = millis();
+
+    // Queue is empty (start of the file or no waiting before) -> read lines until the next command
+    while (command_queue_is_empty() && !is_end_of_file)
+        gcode_read_ahead();
+
+    // Execute next command
+    if (!command_queue_is_empty()) {
+        gcode_execute(command_queue_front());
+        command_queue_pop();
+        return true;
+    }
+
+    // End of file
+    menu_stop_file();
+    return false;
+}
+
+/**
+ * @brief Prepares selected file for the job (call after gcode_clear())
+ * 
+ * @return boolean - false if the file can't be read
+ */
+boolean gcode_start() {
+#ifdef SPEED_GOVERNOR
+    // Continue with the speed settled by the last run of the design
+    speed_governor_start(sd_card_get_needle_speed());
+#endif
+
+    return gcode_open_file();
+}
+
+/**
+ * @brief Opens selected file from its beginning for the read-ahead (job or scan)
+ * 
+ * @return boolean - false if the file can't be read
+ */
+boolean gcode_open_file() {
+    // Check file and start from its beginning
+    if (!sd_card_check_selected_file())
+        return false;
+    sd_card_file_rewind();
+
+    // Binary files start with the header
+    switch (sd_card_get_file_type())
+    {
+        case FILE_TYPE_OEB:
+            return oeb_reader_begin();
+
+        case FILE_TYPE_DST:
+            return dst_reader_begin();
+
+        default:
+            return true;
+    }
+}
+
+/**
+ * @brief Reads design information from the header of the selected file (OEB and DST files,
+ * G-code files have no header, so it's unknown for them). With JOB_PRE_SCAN the whole file is scanned instead
+ * (see gcode_scan_start())
+ * 
+ * @param metadata - stitch count, color count, bounding box and duration
+ * @return boolean - true if metadata is read
+ */
+boolean gcode_read_metadata(file_metadata_t *metadata) {
+    if (!sd_card_check_selected_file())
+        return false;
+    sd_card_file_rewind();
+
+    switch (sd_card_get_file_type())
+    {
+        case FILE_TYPE_OEB:
+            return oeb_reader_read_metadata(metadata);
+
+        case FILE_TYPE_DST:
+            return dst_reader_read_metadata(metadata);
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Starts streaming the selected file through the read-ahead without executing commands (JOB_PRE_SCAN)
+ * The scan runs in slices by gcode_scan_step(), gcode_scan_finish() returns results. Variables are reset,
+ * so call gcode_clear() and gcode_start() before the job (gcode_clear() also cancels the scan)
+ * 
+ * @return boolean - false if the file can't be read
+ */
+boolean gcode_scan_start() {
+    // Start from the beginning of the file with initial values (the speed governor is not started)
+    gcode_clear();
+    if (!gcode_open_file())
+        return false;
+
+    scan_state = SCAN_STATE_RUNNING;
+    scan_timer = millis();
+    scan_busy_time = 0;
+    return true;
+}
+
+/**
+ * @brief Scans the next part of the file for JOB_PRE_SCAN_SLICE_MS (read-ahead task)
+ * Counts stitches, jumps and colors, finds the bounding box and estimates the duration
+ * 
+ */
+void gcode_scan_step(void) {
+    unsigned long start = millis();
+    uint8_t free;
+
+    if (scan_state != SCAN_STATE_RUNNING)
+        return;
+
+    // Read the file and pass all commands to the estimate
+    while (!is_end_of_file || !command_queue_is_empty()) {
+        if (millis() - start >= JOB_PRE_SCAN_SLICE_MS) {
+            scan_busy_time += millis() - start;
+            return;
+        }
+
+        // Fill the queue as the read-ahead task does during the job, so commands see the same next ones
+        // (junction speeds, adaptive needle speed). Lines without commands are skipped while the front
+        // has no next command
+        free = command_queue_get_free();
+        gcode_read_ahead();
+        if (!is_end_of_file && (command_queue_get_free() < free || command_queue_get_free() > COMMAND_QUEUE_LENGTH - 2))
+            continue;
+
+        if (!command_queue_is_empty()) {
+            gcode_adapt_command(command_queue_front());
+            gcode_estimate(command_queue_front());
+            command_queue_pop();
+        }
+    }
+    job_estimate_finish(&job_estimate);
+
+    scan_busy_time += millis() - start;
+    scan_state = SCAN_STATE_DONE;
+}
+
+/**
+ * @brief Returns whether the scan is started and its results are not taken yet
+ * 
+ * @return boolean - true if scanning
+ */
+boolean gcode_is_scanning() {
+    return scan_state != SCAN_STATE_NONE;
+}
+
+/**
+ * @brief Returns read part of the scanned file
+ * 
+ * @return uint8_t - 0 to 100 %
+ */
+uint8_t gcode_get_scan_progress() {
+    uint32_t size = sd_card_get_file_size();
+
+    if (scan_state == SCAN_STATE_DONE)
+        return 100;
+    if (size == 0 || sd_card_get_file_position() >= size)
+        return 99;
+    return (uint64_t)sd_card_get_file_position() * 100 / size;
+}
+
+/**
+ * @brief Returns scan results once the whole file is scanned and drops the read-ahead state
+ * 
+ * @param metadata - stitch count, color count, bounding box and duration
+ * @return boolean - false if the scan is not finished
+ */
+boolean gcode_scan_finish(file_metadata_t *metadata) {
+    if (scan_state != SCAN_STATE_DONE)
+        return false;
+
+    metadata->stitch_count = job_estimate.stitch_count;
+    metadata->jump_count = job_estimate.jump_count;
+    metadata->color_count = job_estimate.color_count;
+
+    // Hundredths -> 0.1 mm
+    metadata->x_min = job_estimate.x_min / 10;
+    metadata->y_min = job_estimate.y_min / 10;
+    metadata->x_max = job_estimate.x_max / 10;
+    metadata->y_max = job_estimate.y_max / 10;
+
+    // Round up to seconds
+    metadata->duration = (job_estimate.duration + 999) / 1000;
+
+#ifdef DEBUG
+    // Scan time on the board (busy - time spent in the scan slices)
+    serial->print(F("Scan: "));
+    serial->print(millis() - scan_timer);
+    serial->print(F(" ms, busy "));
+    serial->print(scan_busy_time);
+    serial->print(F(" ms, "));
+    serial->print(metadata->stitch_count);
+    serial->print(F(" stitches, "));
+    serial->print(metadata->jump_count);
+    serial->print(F(" jumps, "));
+    serial->print(metadata->duration);
+    serial->print(F(" s, "));
+    serial->print(optimizer_dropped_count);
+    serial->println(F(" commands dropped"));
+#endif
+
+    // Drop read-ahead state
+    gcode_clear();
+    return true;
+}
+
+/**
+ * @brief Checks if the condition of the current command is fulfilled
+ * 
+ * @return boolean - true if the next command can be executed
+ */
+boolean gcode_check_condition() {
     switch (next_line_condition)
     {
     case CONDITION_AFTER_MOVE:
-        // Skip this cycle if motors are running
-        if (!is_motors_stopped())
-            return;
-        break;
+        // Skip this cycle until the motors have started and stopped (the loop keeps serving the menu meanwhile)
+        switch (motors_get_move_state())
+        {
+        case MOVE_STATE_DONE:
+            return true;
 
-    case CONDITION_AFTER_INTERRUPT:
-        // If needle interrupt occurs
-        if (needle_sensor_get_interrupt_flag()) {
-            switch (action_after_needle_interrupt)
-            {
-            case ACTION_STOP_MOTOR:
-                // Stop Z motor 
-                motors_stop_z();
+        case MOVE_STATE_REJECTED:
+            gcode_reject_move();
+            return false;
+
+        default:
+            return false;
+        }
 
-                // UNCOMMENT THIS TO MOVE ONLY AFTER THE MAIN MOTOR IS COMPLETELY STOPPED
-                /*// If motor is still running
-                if (!is_motor_z_stopped()) {
-                    // Stop Z motor     
-                    motors_stop_z();
+    case CONDITION_AFTER_MOVE_QUEUED:
+        // Motors refused steps of the move (the rest of it is dropped)
+        if (motors_get_move_state() == MOVE_STATE_REJECTED) {
+            gcode_reject_move();
+            return false;
+        }
 
-                    // Skip this cycle
-                    return;
-                }*/
-                break;
-            
-            default:
-                break;
+        // Move ends with speed, the next one must be started before the motors run out of queued steps
+        return is_motors_move_queued();
+
+    case CONDITION_AFTER_INTERRUPT:
+#ifdef Z_STOP_COMPENSATION
+        if (is_z_stop_early) {
+            // Start the stop before the needle interrupt, so the needle stops at the needle-up position
+            if (action_after_needle_interrupt == ACTION_STOP_MOTOR && motors_get_z_steps() >= z_stop_position) {
+                gcode_stop_z_measured();
+                action_after_needle_interrupt = ACTION_NONE;
             }
+
+            // Stopped before the needle sensor
+            if (action_after_needle_interrupt == ACTION_NONE && is_motor_z_stopped())
+                return true;
         }
+#endif
 
         // No needle interrupt - skip this cycle
-        else
-            return;
+        if (!needle_sensor_get_interrupt_flag())
+            return false;
+
+        switch (action_after_needle_interrupt)
+        {
+        case ACTION_STOP_MOTOR:
+            // Stop Z motor 
+            gcode_stop_z_measured();
+
+            // UNCOMMENT THIS TO MOVE ONLY AFTER THE MAIN MOTOR IS COMPLETELY STOPPED
+            /*// If motor is still running
+            if (!is_motor_z_stopped()) {
+                // Stop Z motor     
+                motors_stop_z();
+
+                // Skip this cycle
+                return false;
+            }*/
+            break;
+        
+        default:
+            break;
+        }
+        return true;
 
     case CONDITION_AFTER_DWELL:
         // Skip this cycle if the time has not passed
-        if (millis() - dwell_timer < dwell_delay)
-            return;
+        return millis() - dwell_timer >= dwell_delay;
+
+    case CONDITION_AFTER_STITCH:
+        // Skip this cycle until Z motor reaches the needle-up position
+        return is_motor_z_stopped();
     
     default:
-        break;
+        return true;
     }
+}
 
-    // Reset needle interrupt flag
-    needle_sensor_clear_interrupt_flag();
+/**
+ * @brief Pauses the job after the motors refused the move or didn't start it
+ * The hoop stays where it is, so the next move starts from the real position after resume
+ * 
+ */
+void gcode_reject_move(void) {
+    x_current = motors_get_x();
+    y_current = motors_get_y();
 
-    // Reset next command condition
-    next_line_condition = CONDITION_IMMEDIATELY;
+    // Motion task doesn't wait, the UI task shows the error before the pause menu
+    menu_pause_file_error(F("Move rejected"));
+}
 
-    // Clear interrupt action
-    action_after_needle_interrupt = ACTION_NONE;
+/**
+ * @brief Reads one line from file and adds its commands to the queue
+ * Does nothing if the queue can't take all commands of the line or the end of file is reached
+ * 
+ */
+void gcode_read_ahead(void) {
+    char *line;
+    uint16_t line_length;
 
-    // Reset delay
-    dwell_delay = 0;
+    // Binary files (readers wait for free space by themselves)
+    switch (sd_card_get_file_type())
+    {
+        case FILE_TYPE_OEB:
+            if (!is_end_of_file && !oeb_reader_read_ahead())
+                is_end_of_file = true;
+            return;
 
-    // Reset Dwell timer
-    dwell_timer = millis();
+        case FILE_TYPE_DST:
+            if (!is_end_of_file && !dst_reader_read_ahead())
+                is_end_of_file = true;
+            return;
+
+        default:
+            break;
+    }
+
+    // One line can contain G-code and M-code (M201 with jerk is two commands)
+    if (is_end_of_file || command_queue_get_free() < 3)
+        return;
 
     // Read line from file
-    if (sd_card_read_next_line()) {
-        ///////////////////////////////////
-        //            G-codes            //
-        ///////////////////////////////////
-        command = gcode_parse_code('G', -1);
+    line = sd_card_read_line(&line_length);
+    if (!line) {
+        is_end_of_file = true;
+        return;
+    }
 
-        switch (command)
-        {
-            case 0:
-            case 1: {
-                // G0, G1 - interpolation movement
+    // Split line into words (single pass)
+    gcode_parser_tokenize(line, &words);
 
-                x_new = gcode_parse_code('X', motors_get_x());
-                y_new = gcode_parse_code('Y', motors_get_y());
-                speed_xy = gcode_parse_code('F', speed_xy);
+    ///////////////////////////////////
+    //            G-codes            //
+    ///////////////////////////////////
+    switch (gcode_parse_code('G', -1))
+    {
+        case 0:
+        case 1:
+            // G0, G1 - interpolation movement
+            x_queued = gcode_parse_fixed('X', x_queued);
+            y_queued = gcode_parse_fixed('Y', y_queued);
+            speed_xy_queued = gcode_parse_code('F', speed_xy_queued);
+            gcode_queue_command(COMMAND_MOVE, 0, x_queued, y_queued, speed_xy_queued);
+            break;
+
+        case 4:
+            // G4 - Delay (Dwell)
+            gcode_queue_command(COMMAND_DWELL, 0, 0, 0, gcode_parse_code('P', 0));
+            break;
+        
+        default:
+            break;
+    }
 
-                // Calculate interpolation factors
-                calculate_interpolation();
+    ///////////////////////////////////
+    //            M-codes            //
+    ///////////////////////////////////
+    switch (gcode_parse_code('M', -1))
+    {
+        case 0:
+            // M0 - Pause
+            gcode_queue_command(COMMAND_PAUSE, 0, 0, 0, gcode_parse_code('C', 0));
+            break;
+
+        case 3:
+            // M3 - Start motor (continuous rotation or until needle interrupt if I1 is in G-code)
+            gcode_queue_command(COMMAND_START_Z, gcode_parse_code('I', 0) > 0 ? COMMAND_FLAG_UNTIL_INTERRUPT : 0,
+                0, 0, gcode_parse_code('S', SPEED_INITIAL_Z_HZ));
+            break;
+
+        case 5:
+            // M5 - Stop and disable motor
+            gcode_queue_command(COMMAND_STOP_Z, 0, 0, 0, 0);
+            break;
+
+        case 17:
+            // M17 - Enable steppers
+            gcode_queue_command(COMMAND_ENABLE, 0, 0, 0, 0);
+            break;
+
+        case 18:
+            // M18 - Disable steppers
+            gcode_queue_command(COMMAND_DISABLE, 0, 0, 0, 0);
+            break;
+
+        case 41:
+            // M41 - Remove thread tension
+            gcode_queue_command(COMMAND_TENSION, 0, 0, 0, 0);
+            break;
+
+        case 42:
+            // M42 - Set high thread tension
+            gcode_queue_command(COMMAND_TENSION, 0, 0, 0, 1);
+            break;
+            
+        case 73:
+            // M73 - Set progress
+            progress_queued = gcode_parse_code('P', progress_queued);
+            gcode_queue_command(COMMAND_PROGRESS, 0, 0, 0, progress_queued);
+            break;
+
+        case 201:
+            // M201 - Set accelerations
+            acceleration_x_queued = gcode_parse_code('X', acceleration_x_queued);
+            acceleration_y_queued = gcode_parse_code('Y', acceleration_y_queued);
+            gcode_queue_command(COMMAND_ACCELERATION, 0, acceleration_x_queued, acceleration_y_queued,
+                gcode_parse_code('Z', ACCELERATION_INITIAL_Z_HZ));
+
+            // Jerk of X and Y (only if it's set)
+            if (gcode_parse_code('J', -1) >= 0)
+                gcode_queue_command(COMMAND_JERK, 0, 0, 0, gcode_parse_code('J', 0));
+            break;
+        
+        default:
+            break;
+    }
+}
 
-                // Update speed and accelertion
-                motors_set_speed_x(speed_xy * interpolation_x);
-                motors_set_speed_y(speed_xy * interpolation_y);
-                motors_set_acceleration_x(acceleration_x * interpolation_x);
-                motors_set_acceleration_y(acceleration_y * interpolation_y);
+/**
+ * @brief Adds command to the end of the queue
+ * 
+ * @param type - COMMAND_...
+ * @param flags - COMMAND_FLAG_...
+ * @param x - first argument (see COMMAND_... description)
+ * @param y - second argument
+ * @param value - third argument
+ */
+void gcode_queue_command(uint8_t type, uint8_t flags, int32_t x, int32_t y, uint32_t value) {
+    command_t *command;
+
+#ifdef COMMAND_OPTIMIZER
+    // Redundant command (or merged move)
+    if (!gcode_optimize_command(type, x, y, value)) {
+        optimizer_dropped_count++;
+        return;
+    }
+#endif
+
+    command = command_queue_push();
+    command->type = type;
+    command->flags = flags;
+    command->x = x;
+    command->y = y;
+    command->value = value;
+}
 
-                // Move motors to new position
-                motors_move_to_position(&x_new, &y_new);
+/**
+ * @brief Checks the command against the last queued values before it is queued (COMMAND_OPTIMIZER)
+ * Drops moves to the current position and repeated accelerations, tensions and progress values
+ * (the dwell that directly follows a dropped tension change too, it only lets the servo settle).
+ * A move that continues the last queued move along the same line with the same speed extends that move
+ * 
+ * @param type - COMMAND_...
+ * @param x - first argument (see COMMAND_... description)
+ * @param y - second argument
+ * @param value - third argument
+ * @return boolean - true if the command must be queued
+ */
+boolean gcode_optimize_command(uint8_t type, int32_t x, int32_t y, uint32_t value) {
+    command_t *last;
+    int32_t last_x_d, last_y_d, x_d, y_d;
+    uint32_t distance;
+    int64_t cross;
+    boolean is_tension_dropped = is_optimizer_tension_dropped;
+
+    is_optimizer_tension_dropped = false;
+    switch (type)
+    {
+        case COMMAND_MOVE:
+            // Move to the current position
+            if (x == optimizer_x && y == optimizer_y)
+                return false;
+
+            // Last queued command is a move with the same speed
+            last = command_queue_back();
+            if (last && last->type == COMMAND_MOVE && last->value == value) {
+                last_x_d = optimizer_x - optimizer_x_start;
+                last_y_d = optimizer_y - optimizer_y_start;
+                x_d = x - optimizer_x_start;
+                y_d = y - optimizer_y_start;
+                distance = isqrt32((uint32_t)abs(x_d) * abs(x_d) + (uint32_t)abs(y_d) * abs(y_d));
+
+                // Distance of the last end point from the merged line (cross product / length of the line)
+                cross = (int64_t)last_x_d * y_d - (int64_t)last_y_d * x_d;
+                if (cross < 0)
+                    cross = -cross;
+
+                // The new end point must be ahead of the last one
+                if ((int64_t)(x - optimizer_x) * last_x_d + (int64_t)(y - optimizer_y) * last_y_d > 0
+                    && cross <= (int64_t)COMMAND_OPTIMIZER_DEVIATION * distance) {
+                    last->x = x;
+                    last->y = y;
+                    optimizer_x = x;
+                    optimizer_y = y;
+                    return false;
+                }
+            }
+
+            optimizer_x_start = optimizer_x;
+            optimizer_y_start = optimizer_y;
+            optimizer_x = x;
+            optimizer_y = y;
+            return true;
+
+        case COMMAND_DWELL:
+            return !is_tension_dropped;
 
-                // Parse next line after motors stopped
-                next_line_condition = CONDITION_AFTER_MOVE;
-                break;
+        case COMMAND_TENSION:
+            if (value == optimizer_tension) {
+                is_optimizer_tension_dropped = true;
+                return false;
             }
+            optimizer_tension = value;
+            return true;
+
+        case COMMAND_PROGRESS:
+            if (value == optimizer_progress)
+                return false;
+            optimizer_progress = value;
+            return true;
+
+        case COMMAND_ACCELERATION:
+            if (x == (int32_t)optimizer_acceleration_x && y == (int32_t)optimizer_acceleration_y
+                && value == optimizer_acceleration_z)
+                return false;
+            optimizer_acceleration_x = x;
+            optimizer_acceleration_y = y;
+            optimizer_acceleration_z = value;
+            return true;
+
+        case COMMAND_JERK:
+            if (value == optimizer_jerk)
+                return false;
+            optimizer_jerk = value;
+            return true;
+
+        default:
+            return true;
+    }
+}
 
-            case 4:
-                // G4 - Delay (Dwell)
-                dwell_delay = gcode_parse_code('P', 0);
+/**
+ * @brief Forgets the last queued values, so the next commands are queued as they are (COMMAND_OPTIMIZER)
+ * Call when the queue is cleared
+ * 
+ */
+void gcode_optimizer_reset(void) {
+    optimizer_x = x_current;
+    optimizer_y = y_current;
+    optimizer_x_start = x_current;
+    optimizer_y_start = y_current;
+    optimizer_acceleration_x = UINT32_MAX;
+    optimizer_acceleration_y = UINT32_MAX;
+    optimizer_acceleration_z = UINT32_MAX;
+    optimizer_jerk = UINT32_MAX;
+    optimizer_tension = OPTIMIZER_UNKNOWN;
+    optimizer_progress = OPTIMIZER_UNKNOWN;
+    is_optimizer_tension_dropped = false;
+}
 
-                // Parse next line after dwell timer
-                next_line_condition = CONDITION_AFTER_DWELL;
-                break;
-            
-            default:
-                break;
-        }
+/**
+ * @brief Executes pre-decoded command and sets condition for the next one
+ * 
+ * @param command - command from the front of the queue (the following ones are used for look-ahead)
+ */
+void gcode_execute(command_t *command) {
+    uint32_t acceleration, exit_speed = 0;
+
+    // Count the command in the elapsed time (with the values chosen by the firmware)
+    gcode_adapt_command(command);
+    gcode_estimate(command);
+
+#ifdef CONTINUOUS_NEEDLE
+    // Stop the running main motor before commands that need the needle up (stop-and-go)
+    if (is_needle_running && !gcode_keeps_needle_running(command)) {
+        motors_stop_z();
+        is_needle_running = false;
+    }
+#endif
 
-        ///////////////////////////////////
-        //            M-codes            //
-        ///////////////////////////////////
-        command = gcode_parse_code('M', -1);
-        switch (command)
-        {
-            case 0:
-                // M0 - Pause
-                // Parse paused code
-                paused_code = gcode_parse_code('C', 0);
-
-                // Pause motors
-                gcode_pause();
-
-                // Draw paused menu
-                menu_pause_file();
-                break;
-
-            case 3:
-                // M3 - Enable and start motor (continues rotation or until needle interrupt)
-                // Enable Z motor
-                motors_enable_z();
-
-                // Set speed of Z motor
-                speed_z = gcode_parse_code('S', SPEED_INITIAL_Z_HZ);
-                motors_set_speed_z(speed_z);
-
-                // Rotate motor until needle interrupt if I1 is in G-code 
-                if (gcode_parse_code('I', 0) > 0) {
-                    // Clear interrupt flag
-                    needle_sensor_clear_interrupt_flag();
-
-                    // Stop z motor after needle interrupt
-                    next_line_condition = CONDITION_AFTER_INTERRUPT;
-                    action_after_needle_interrupt = ACTION_STOP_MOTOR;
+    switch (command->type)
+    {
+        case COMMAND_MOVE:
+            // G0, G1 - interpolation movement
+            x_new = command->x;
+            y_new = command->y;
+
+            // Calculate interpolation factors (skip zero-length move)
+            if (calculate_interpolation()) {
+#ifdef COORDINATED_MOVES
+                // One ramp along the line with the acceleration of the slowest moving axis
+                acceleration = interpolation_x_d > 0 ? acceleration_x : acceleration_y;
+                if (interpolation_y_d > 0 && acceleration_y < acceleration)
+                    acceleration = acceleration_y;
+#ifdef JUNCTION_DEVIATION
+                // Keep moving through the end point if the next command is a move
+                exit_speed = gcode_get_junction_speed(command, x_current, y_current,
+                    acceleration_x < acceleration_y ? acceleration_x : acceleration_y);
+#endif
+#ifdef S_CURVE_MOVES
+                motors_move_line(x_new, y_new, interpolation_distance, command->value, acceleration, jerk_xy,
+                    exit_speed);
+#else
+                motors_move_line(x_new, y_new, interpolation_distance, command->value, acceleration, 0, exit_speed);
+#endif
+#else
+                // Update speed and acceleration of moving axes (products are 64-bit, see calculate_interpolation()).
+                // Acceleration of a nearly perpendicular axis is at least 1, the motor doesn't take 0
+                if (interpolation_x_d > 0) {
+                    motors_set_speed_x((uint64_t)command->value * STEPS_PER_MM_X * interpolation_x_d
+                        / interpolation_distance);
+                    acceleration = (uint64_t)acceleration_x * STEPS_PER_MM_X * interpolation_x_d / interpolation_distance;
+                    motors_set_acceleration_x(acceleration > 0 ? acceleration : 1);
+                }
+                if (interpolation_y_d > 0) {
+                    motors_set_speed_y((uint64_t)command->value * STEPS_PER_MM_Y * interpolation_y_d
+                        / interpolation_distance);
+                    acceleration = (uint64_t)acceleration_y * STEPS_PER_MM_Y * interpolation_y_d / interpolation_distance;
+                    motors_set_acceleration_y(acceleration > 0 ? acceleration : 1);
                 }
 
-                // Continuous rotation
-                else {
-                    // Reset line condition and action
-                    next_line_condition = CONDITION_IMMEDIATELY;
+                // Move motors to new position
+                motors_move_to_position(x_new, y_new);
+#endif
+            }
+
+            // Store target position for next move
+            x_current = x_new;
+            y_current = y_new;
+
+#ifdef TENSION_SCHEDULING
+            // Tension change that follows the move is made during it
+            gcode_schedule_tension();
+#endif
+
+            // Execute next command after motors stopped (or after all steps are queued if the move ends with speed)
+            next_line_condition = exit_speed > 0 ? CONDITION_AFTER_MOVE_QUEUED : CONDITION_AFTER_MOVE;
+            break;
+
+        case COMMAND_DWELL:
+            // G4 - Delay (Dwell)
+            dwell_delay = command->value;
+
+#ifdef TENSION_SCHEDULING
+            // Only the rest of the servo move is waited for
+            if ((command->flags & COMMAND_FLAG_SERVO_SETTLE) && servo_get_remaining_time() < dwell_delay)
+                dwell_delay = servo_get_remaining_time();
+#endif
+
+            // Execute next command after dwell timer
+            next_line_condition = CONDITION_AFTER_DWELL;
+            break;
+
+        case COMMAND_PAUSE:
+            // M0 - Pause
+            paused_code = command->value;
+
+            // Pause motors
+            gcode_pause();
+
+            // Draw paused menu
+            menu_pause_file();
+            break;
+
+        case COMMAND_START_Z:
+            // M3 - Enable and start motor (continues rotation or until needle interrupt)
+            // Enable Z motor
+            motors_enable_z();
+
+            // Set speed of Z motor
+            speed_z = command->value;
+            motors_set_speed_z(speed_z);
+
+            // Rotate motor until needle interrupt
+            if (command->flags & COMMAND_FLAG_UNTIL_INTERRUPT) {
+                // Clear interrupt flag
+                needle_sensor_clear_interrupt_flag();
+
+#ifdef SPEED_GOVERNOR
+                if (speed_z > 0)
+                    speed_governor_stitch();
+#endif
+
+                // Stop z motor after needle interrupt
+                next_line_condition = CONDITION_AFTER_INTERRUPT;
+                action_after_needle_interrupt = ACTION_STOP_MOTOR;
+
+#ifdef CONTINUOUS_NEEDLE
+                // Keep rotating, the next move starts at the needle interrupt (needle is up)
+                action_after_needle_interrupt = ACTION_NONE;
+                is_needle_running = speed_z > 0;
+#elif defined(Z_POSITION_STITCH)
+                // Move exactly to the needle-up position instead of stopping after the interrupt
+                if (speed_z > 0) {
+                    next_line_condition = CONDITION_AFTER_STITCH;
                     action_after_needle_interrupt = ACTION_NONE;
+                    motors_move_z_to(gcode_get_needle_up_position());
+                    break;
                 }
-                
-                // Start Z motor
-                if (speed_z > 0)
-                    motors_start_z();
+#endif
 
-                // Stop Z motor
-                else
-                    motors_stop_z();
-                break;
+#ifdef Z_STOP_COMPENSATION
+                // Learn the previous stop and find where to start this one
+                if (!is_needle_running)
+                    gcode_prepare_z_stop();
+#endif
+            }
 
-            case 5:
-                // M5 - Stop and disable motor
-                motors_disable_z();
+            // Continuous rotation
+            else {
+                // Reset line condition and action
+                next_line_condition = CONDITION_IMMEDIATELY;
+                action_after_needle_interrupt = ACTION_NONE;
+            }
+            
+            // Start Z motor (for one stitch or continuous rotation)
+            if (speed_z > 0 && action_after_needle_interrupt == ACTION_STOP_MOTOR)
+                motors_start_z_stitch();
+            else if (speed_z > 0)
+                motors_start_z();
+
+            // Stop Z motor
+            else
                 motors_stop_z();
-                break;
-
-            case 17:
-                // M17 - Enable steppers
-                motors_enable();
-                break;
-
-            case 18:
-                // M18 - Disable steppers
-                motors_disable();
-                break;
-
-            case 41:
-                // Remove thread tension
-                servo_set_tension(0);
-                is_tensioned = false;
-                break;
-
-            case 42:
-                // Set high thread tension
-                servo_set_tension(tension_);
-                is_tensioned = true;
-                break;
-                
-            case 73:
-                // M73 - Set progress
-                progress = gcode_parse_code('P', progress);
-                if (progress > 100)
-                    progress = 100;
-                lcd_print_progress();
-                break;
-
-            case 201:
-                // M201 - Set accelerations
-                acceleration_x = gcode_parse_code('X', acceleration_x);
-                acceleration_y = gcode_parse_code('Y', acceleration_y);
-
-                motors_set_acceleration_x(acceleration_x);
-                motors_set_acceleration_y(acceleration_y);
-                motors_set_acceleration_z(gcode_parse_code('Z', ACCELERATION_INITIAL_Z_HZ));
-                break;
+            break;
+
+        case COMMAND_STOP_Z:
+            // M5 - Stop and disable motor
+            motors_disable_z();
+            motors_stop_z();
+            break;
+
+        case COMMAND_ENABLE:
+            // M17 - Enable steppers
+            motors_enable();
+            break;
+
+        case COMMAND_DISABLE:
+            // M18 - Disable steppers
+            motors_disable();
+            break;
+
+        case COMMAND_TENSION:
+            // M41 - Remove thread tension, M42 - Set high thread tension
+            is_tensioned = command->value > 0;
+            is_tension_scheduled = false;
+            servo_set_tension(is_tensioned ? tension_ : 0);
+            break;
             
-            default:
-                break;
-        }
+        case COMMAND_PROGRESS:
+            // M73 - Set progress
+            progress = command->value;
+            if (progress > 100)
+                progress = 100;
+            is_progress_changed = true;
+            break;
+
+        case COMMAND_ACCELERATION:
+            // M201 - Set accelerations
+            acceleration_x = command->x;
+            acceleration_y = command->y;
+
+            motors_set_acceleration_x(acceleration_x * STEPS_PER_MM_X);
+            motors_set_acceleration_y(acceleration_y * STEPS_PER_MM_Y);
+            acceleration_z = command->value;
+            motors_set_acceleration_z(acceleration_z);
+            break;
+
+        case COMMAND_JERK:
+            // M201 J - Set jerk (used by S_CURVE_MOVES)
+            jerk_xy = command->value;
+            break;
+        
+        default:
+            break;
     }
+}
 
-    // End of file
-    else
-        menu_stop_file();
+/**
+ * @brief Adds command to the job estimate (same speeds and accelerations as gcode_execute() uses)
+ * 
+ * @param command - command from the queue
+ */
+void gcode_estimate(command_t *command) {
+    uint32_t exit_speed = 0;
+
+    switch (command->type)
+    {
+        case COMMAND_MOVE:
+#ifdef JUNCTION_DEVIATION
+            // Same speed at the end point as gcode_execute() plans (the next move must be queued, see gcode_scan_step())
+            exit_speed = gcode_get_junction_speed(command, job_estimate.x, job_estimate.y,
+                job_estimate.acceleration_x < job_estimate.acceleration_y
+                ? job_estimate.acceleration_x : job_estimate.acceleration_y);
+#endif
+            job_estimate_move(&job_estimate, command->x, command->y, command->value, exit_speed);
+            break;
+
+        case COMMAND_DWELL:
+            job_estimate_dwell(&job_estimate, command->value);
+            break;
+
+        case COMMAND_PAUSE:
+            job_estimate_pause(&job_estimate, command->value);
+            break;
+
+        case COMMAND_START_Z:
+            // Only single stitches have known duration
+            if (command->flags & COMMAND_FLAG_UNTIL_INTERRUPT)
+                job_estimate_stitch(&job_estimate, command->value);
+            break;
+
+        case COMMAND_ACCELERATION:
+            job_estimate_acceleration(&job_estimate, command->x, command->y, command->value);
+            break;
+
+#ifdef S_CURVE_MOVES
+        case COMMAND_JERK:
+            job_estimate_jerk(&job_estimate, command->value);
+            break;
+#endif
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Replaces values of the command that are chosen by the firmware (before it's executed or estimated)
+ * 
+ * @param command - command from the front of the queue (the following ones are used for look-ahead)
+ */
+void gcode_adapt_command(command_t *command) {
+#ifdef TENSION_SCHEDULING
+    boolean is_after_tension = is_adapt_after_tension;
+
+    is_adapt_after_tension = false;
+#endif
+
+    switch (command->type)
+    {
+        case COMMAND_START_Z:
+#ifdef ADAPTIVE_NEEDLE_SPEED
+            if (command->flags & COMMAND_FLAG_UNTIL_INTERRUPT)
+                command->value = gcode_get_adaptive_needle_speed();
+#endif
+#ifdef SPEED_GOVERNOR
+            // Stitch speed tuned by the needle sync (not in the scan, its estimate is stored for all runs of the design)
+            if ((command->flags & COMMAND_FLAG_UNTIL_INTERRUPT) && scan_state == SCAN_STATE_NONE)
+                command->value = speed_governor_apply(command->value);
+#endif
+            break;
+
+#ifdef ADAPTIVE_NEEDLE_SPEED
+        case COMMAND_STOP_Z:
+            // Speed ramps up again from the minimum
+            needle_speed_last = 0;
+            break;
+#endif
+
+#ifdef TENSION_SCHEDULING
+        case COMMAND_TENSION:
+            adapt_tension_time = servo_get_tension_time(adapt_tension > 0 ? tension_ : 0,
+                                                        command->value > 0 ? tension_ : 0);
+            adapt_tension = command->value > 0;
+            is_adapt_after_tension = true;
+            break;
+
+        case COMMAND_DWELL:
+            // Dwell that directly follows a tension change waits at most for the modeled servo move
+            if (is_after_tension) {
+                command->flags |= COMMAND_FLAG_SERVO_SETTLE;
+                if (command->value > adapt_tension_time)
+                    command->value = adapt_tension_time;
+            }
+            break;
+#endif
+
+        default:
+            break;
+    }
+}
+
+#ifdef ADAPTIVE_NEEDLE_SPEED
+/**
+ * @brief Chooses needle speed of the stitch (ADAPTIVE_NEEDLE_SPEED)
+ * Uses the length of the last move (the thread pulled by this stitch) and, with CONTINUOUS_NEEDLE, the duration of
+ * the next move, which must fit into the needle-up window: steps per revolution * window / speed >= duration
+ * 
+ * @return uint32_t - speed (steps/s)
+ */
+uint32_t gcode_get_adaptive_needle_speed(void) {
+    uint32_t speed = ADAPTIVE_NEEDLE_SPEED_MAX_HZ, length = job_estimate.move_distance;
+#ifdef CONTINUOUS_NEEDLE
+    command_t *next;
+    uint32_t x_d, y_d, distance, acceleration, duration;
+    uint8_t index = 1;
+#endif
+
+    // Longer stitches are made slower
+    if (length >= ADAPTIVE_NEEDLE_LONG_STITCH)
+        speed = ADAPTIVE_NEEDLE_SPEED_MIN_HZ;
+    else if (length > ADAPTIVE_NEEDLE_SHORT_STITCH)
+        speed -= (uint32_t)(ADAPTIVE_NEEDLE_SPEED_MAX_HZ - ADAPTIVE_NEEDLE_SPEED_MIN_HZ)
+            * (length - ADAPTIVE_NEEDLE_SHORT_STITCH) / (ADAPTIVE_NEEDLE_LONG_STITCH - ADAPTIVE_NEEDLE_SHORT_STITCH);
+
+#ifdef CONTINUOUS_NEEDLE
+    // Next move before the next stitch (if it's already queued)
+    do {
+        next = command_queue_get(index++);
+    } while (next && next->type != COMMAND_MOVE && next->type != COMMAND_START_Z);
+
+    if (next && next->type == COMMAND_MOVE) {
+        x_d = next->x > job_estimate.x ? next->x - job_estimate.x : job_estimate.x - next->x;
+        y_d = next->y > job_estimate.y ? next->y - job_estimate.y : job_estimate.y - next->y;
+        distance = isqrt32(x_d * x_d + y_d * y_d);
+
+        // Acceleration of the slowest moving axis (same as job_estimate_move())
+        acceleration = x_d > 0 ? job_estimate.acceleration_x : job_estimate.acceleration_y;
+        if (y_d > 0 && job_estimate.acceleration_y < acceleration)
+            acceleration = job_estimate.acceleration_y;
+
+        duration = distance > 0 ? job_estimate_move_duration(&job_estimate, distance, next->value, acceleration, 0, 0)
+            : 0;
+        if (duration > 0 && (uint32_t)STEPS_PER_REVOLUTION_Z * NEEDLE_UP_WINDOW_PERCENT * 10 / duration < speed)
+            speed = (uint32_t)STEPS_PER_REVOLUTION_Z * NEEDLE_UP_WINDOW_PERCENT * 10 / duration;
+    }
+#endif
+
+    // Start from the minimum after the motor was stopped, then speed up by the ramp
+    if (needle_speed_last == 0 || speed < ADAPTIVE_NEEDLE_SPEED_MIN_HZ)
+        speed = ADAPTIVE_NEEDLE_SPEED_MIN_HZ;
+    else if (speed > needle_speed_last + ADAPTIVE_NEEDLE_SPEED_RAMP_HZ)
+        speed = needle_speed_last + ADAPTIVE_NEEDLE_SPEED_RAMP_HZ;
+
+    // Round down to the speed step (the maximum is kept as is)
+    if (speed < ADAPTIVE_NEEDLE_SPEED_MAX_HZ)
+        speed -= (speed - ADAPTIVE_NEEDLE_SPEED_MIN_HZ) % ADAPTIVE_NEEDLE_SPEED_STEP_HZ;
+
+    needle_speed_last = speed;
+    return speed;
+}
+#endif
+
+#ifdef TENSION_SCHEDULING
+/**
+ * @brief Schedules the tension change that follows the started move, so the servo finishes together with it
+ * (TENSION_SCHEDULING). Progress and acceleration commands between them are skipped, a stitch isn't
+ * 
+ */
+void gcode_schedule_tension(void) {
+    command_t *next;
+    uint8_t index = 1, tension;
+    uint32_t time;
+
+    is_tension_scheduled = false;
+    do {
+        next = command_queue_get(index++);
+    } while (next && (next->type == COMMAND_PROGRESS || next->type == COMMAND_ACCELERATION
+                      || next->type == COMMAND_JERK));
+    if (!next || next->type != COMMAND_TENSION)
+        return;
+
+    tension = next->value > 0 ? tension_ : 0;
+    time = servo_get_move_time(tension);
+    if (time == 0)
+        return;
+
+    // Move duration is taken from the job estimate
+    scheduled_tension = tension;
+    tension_schedule_time = millis() + (job_estimate.last_duration > time ? job_estimate.last_duration - time : 0);
+    is_tension_scheduled = true;
+}
+#endif
+
+/**
+ * @brief Checks if the command can be executed while the main motor keeps running (CONTINUOUS_NEEDLE)
+ * The move must end inside the needle-up window, which starts at the needle interrupt
+ * 
+ * @param command - command from the queue (already added to the job estimate)
+ * @return boolean - false if the motor must be stopped before the command
+ */
+boolean gcode_keeps_needle_running(command_t *command) {
+    uint32_t period;
+    int32_t window;
+
+    switch (command->type)
+    {
+        case COMMAND_MOVE:
+            // Rest of the needle-up window (us) from the measured needle phase
+            period = needle_sensor_get_period();
+            if (period > 0)
+                window = needle_sensor_get_time_to_needle_up() - period / 100 * (100 - NEEDLE_UP_WINDOW_PERCENT);
+
+            // Whole window at the commanded speed
+            else
+                window = (uint32_t)STEPS_PER_REVOLUTION_Z * 10000 / speed_z * NEEDLE_UP_WINDOW_PERCENT;
+
+            return window > 0 && job_estimate.last_duration * 1000 <= (uint32_t)window;
+
+        case COMMAND_START_Z:
+            return command->flags & COMMAND_FLAG_UNTIL_INTERRUPT;
+
+        case COMMAND_PROGRESS:
+        case COMMAND_ACCELERATION:
+        case COMMAND_JERK:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+#ifdef JUNCTION_DEVIATION
+/**
+ * @brief Plans speed at the end of the current move (JUNCTION_DEVIATION)
+ * The hoop keeps moving only if the next command (progress updates are skipped) is a move that is already queued.
+ * Speed is limited by the angle between the moves (the path may cut the corner by JUNCTION_DEVIATION),
+ * by both speeds and by the length of the next move, so it can still stop at its end.
+ * The job estimate plans with it in the same way (from its own position and accelerations)
+ * 
+ * @param command - current move (front of the queue)
+ * @param x - start of the current move (hundredths of mm)
+ * @param y - start of the current move (hundredths of mm)
+ * @param acceleration - acceleration of the slower axis (mm/s^2)
+ * @return uint32_t - speed at the end point (mm/s, 0 - stop)
+ */
+uint32_t gcode_get_junction_speed(command_t *command, int32_t x, int32_t y, uint32_t acceleration) {
+    command_t *next;
+    int32_t next_x, next_y, cos_theta;
+    uint32_t x_d, y_d, distance, next_x_d, next_y_d, next_distance, sin_half, speed_square;
+    uint32_t speed = command->value;
+    uint8_t index = 1;
+
+    // Next command that isn't a progress update
+    do {
+        next = command_queue_get(index++);
+    } while (next && next->type == COMMAND_PROGRESS);
+    if (!next || next->type != COMMAND_MOVE)
+        return 0;
+
+    // Current move
+    x_d = command->x > x ? command->x - x : x - command->x;
+    y_d = command->y > y ? command->y - y : y - command->y;
+    distance = isqrt32(x_d * x_d + y_d * y_d);
+    if (distance == 0 || acceleration == 0)
+        return 0;
+
+    // Next move
+    next_x = next->x - command->x;
+    next_y = next->y - command->y;
+    next_x_d = next_x > 0 ? next_x : -next_x;
+    next_y_d = next_y > 0 ? next_y : -next_y;
+    next_distance = isqrt32(next_x_d * next_x_d + next_y_d * next_y_d);
+    if (next_distance == 0)
+        return 0;
+
+    // Next move shorter than a step can't take the speed
+    if (motors_fixed_to_steps(next->x, STEPS_PER_MM_X) == motors_fixed_to_steps(command->x, STEPS_PER_MM_X)
+        && motors_fixed_to_steps(next->y, STEPS_PER_MM_Y) == motors_fixed_to_steps(command->y, STEPS_PER_MM_Y))
+        return 0;
+
+    // Both moves use the acceleration of the slowest axis
+    if (next->value < speed)
+        speed = next->value;
+
+    // Cosine of the turn angle (1/2^20) from unit vectors (1/1024)
+    cos_theta = ((command->x - x) * 1024 / (int32_t)distance) * (next_x * 1024 / (int32_t)next_distance)
+        + ((command->y - y) * 1024 / (int32_t)distance) * (next_y * 1024 / (int32_t)next_distance);
+
+    // Sine of the half of the angle between the moves (1/1024): 1024 - straight line, 0 - reversal
+    sin_half = isqrt32((((uint32_t)1 << 20) + cos_theta) / 2);
+    if (sin_half == 0)
+        return 0;
+
+    // Corner: v^2 = a * deviation * sin / (1 - sin)
+    if (sin_half < 1024) {
+        speed_square = acceleration * JUNCTION_DEVIATION / (1024 - sin_half) * sin_half / GCODE_FIXED_SCALE;
+        if (speed_square < speed * speed)
+            speed = isqrt32(speed_square);
+    }
+
+    // Next move must be long enough to stop: v^2 <= 2 * a * distance
+    if (next_distance < UINT32_MAX / 2 / acceleration) {
+        speed_square = 2 * acceleration * next_distance / GCODE_FIXED_SCALE;
+        if (speed_square < speed * speed)
+            speed = isqrt32(speed_square);
+    }
+    return speed;
+}
+
+/**
+ * @brief Starts the next planned move if the current one is completely queued and ends with speed (JUNCTION_DEVIATION)
+ * The planner made the next move long enough to stop in, so motors_stop() decelerates along it instead of leaving
+ * the design path. The move stays in the queue and is finished from the real position after resume
+ * 
+ */
+void gcode_brake_on_next_move(void) {
+    command_t *next;
+    uint32_t acceleration;
+    uint8_t index = 0;
+
+    // Motors already ran out of steps or refused them
+    if (next_line_condition != CONDITION_AFTER_MOVE_QUEUED || is_motors_stopped()
+        || motors_get_move_state() == MOVE_STATE_REJECTED)
+        return;
+
+    // Next command that isn't a progress update (same as gcode_get_junction_speed(), the current one is popped)
+    do {
+        next = command_queue_get(index++);
+    } while (next && next->type == COMMAND_PROGRESS);
+    if (!next || next->type != COMMAND_MOVE)
+        return;
+
+    x_new = next->x;
+    y_new = next->y;
+    if (!calculate_interpolation())
+        return;
+
+    // Same ramp as gcode_execute(), but stopping at the end
+    acceleration = interpolation_x_d > 0 ? acceleration_x : acceleration_y;
+    if (interpolation_y_d > 0 && acceleration_y < acceleration)
+        acceleration = acceleration_y;
+#ifdef S_CURVE_MOVES
+    motors_move_line(x_new, y_new, interpolation_distance, next->value, acceleration, jerk_xy, 0);
+#else
+    motors_move_line(x_new, y_new, interpolation_distance, next->value, acceleration, 0, 0);
+#endif
+}
+#endif
+
+/**
+ * @brief Finds Z position of the needle-up stop about one revolution ahead (Z_POSITION_STITCH)
+ * The position is counted from the last needle sensor pulse, so steps lost or gained in previous revolutions
+ * (and the overshoot of stops with deceleration) don't accumulate
+ * 
+ * @return int32_t - Z position in steps (half to one and a half revolutions ahead)
+ */
+int32_t gcode_get_needle_up_position() {
+    int32_t position = motors_get_z_steps() + STEPS_PER_REVOLUTION_Z;
+    int32_t index, revolutions;
+
+    // No needle pulse yet
+    if (!needle_sensor_get_index_position(&index))
+        return position;
+
+    // Needle-up position nearest to one revolution ahead
+    index += NEEDLE_UP_OFFSET_STEPS;
+    revolutions = (position - index + (position >= index ? STEPS_PER_REVOLUTION_Z / 2 : -STEPS_PER_REVOLUTION_Z / 2))
+        / STEPS_PER_REVOLUTION_Z;
+    return index + revolutions * STEPS_PER_REVOLUTION_Z;
+}
+
+#ifdef Z_STOP_COMPENSATION
+/**
+ * @brief Learns the finished Z stop and arms the early stop of the next stitch (Z_STOP_COMPENSATION)
+ * Call before the stitch starts Z motor
+ * 
+ */
+void gcode_prepare_z_stop(void) {
+    int32_t steps;
+
+    // Previous stop is finished (stops that are still running are not learned)
+    if (is_z_stop_measured && is_motor_z_stopped())
+        z_stop_table_learn(z_stop_speed, z_stop_acceleration, motors_get_z_steps() - z_stop_start);
+    is_z_stop_measured = false;
+    is_z_stop_early = false;
+
+    // Needle-up position is known only from the stopped motor and the checked steps per revolution
+    steps = needle_sensor_get_steps_per_revolution() - STEPS_PER_REVOLUTION_Z;
+    if (!is_motor_z_stopped() || abs(steps) > STEPS_PER_REVOLUTION_Z / 16)
+        return;
+
+    // Learned stop must be shorter than half of the revolution
+    steps = z_stop_table_get(speed_z, acceleration_z);
+    if (steps < 0 || steps >= STEPS_PER_REVOLUTION_Z / 2)
+        return;
+
+    z_stop_position = gcode_get_needle_up_position() - steps;
+    is_z_stop_early = true;
+}
+#endif
+
+/**
+ * @brief Stops Z motor with deceleration and starts measuring the stop length
+ * 
+ */
+void gcode_stop_z_measured(void) {
+    motors_stop_z();
+
+#ifdef Z_STOP_COMPENSATION
+    z_stop_start = motors_get_z_steps();
+    z_stop_speed = speed_z;
+    z_stop_acceleration = acceleration_z;
+    is_z_stop_measured = true;
+#endif
+}
+
+/**
+ * @brief Sets estimated duration of the started job
+ * 
+ * @param duration - s (0 - unknown)
+ */
+void gcode_set_duration(uint32_t duration) {
+    job_duration = duration * 1000;
+}
+
+/**
+ * @brief Returns estimated time until the end of the job (without pauses)
+ * 
+ * @return int32_t - s (-1 if unknown)
+ */
+int32_t gcode_get_remaining_time() {
+    if (job_duration == 0)
+        return -1;
+    if (job_estimate.duration >= job_duration)
+        return 0;
+    return (job_duration - job_estimate.duration + 999) / 1000;
 }
 
 /**
@@ -272,6 +1333,23 @@ uint8_t gcode_get_progress() {
     return progress;
 }
 
+/**
+ * @brief Returns whether the progress changed since the flag was cleared
+ * 
+ * @return boolean - true if the LCD should be updated
+ */
+boolean gcode_get_progress_flag() {
+    return is_progress_changed;
+}
+
+/**
+ * @brief Clears progress changed flag (after the LCD is updated)
+ * 
+ */
+void gcode_clear_progress_flag(void) {
+    is_progress_changed = false;
+}
+
 /**
  * @brief Returns paused code
  * 
@@ -296,12 +1374,20 @@ void gcode_clear(void) {
     // Reset variables
     x_new = 0;
     y_new = 0;
-    interpolation_x = 1;
-    interpolation_y = 1;
-    command = 0;
+    x_current = motors_get_x();
+    y_current = motors_get_y();
     progress = 0;
+    is_progress_changed = false;
     paused_code = 0;
     is_tensioned = 0;
+    is_needle_running = false;
+    is_z_stop_early = false;
+    is_z_stop_measured = false;
+    needle_speed_last = 0;
+    is_tension_scheduled = false;
+    adapt_tension = 0;
+    adapt_tension_time = 0;
+    is_adapt_after_tension = false;
 
     // Reset line condition
     next_line_condition = CONDITION_IMMEDIATELY;
@@ -313,19 +1399,50 @@ void gcode_clear(void) {
     needle_sensor_clear_interrupt_flag();
 
     // Set initial speeds and accelerations
-    speed_xy = SPEED_INITIAL_XY_MM_S;
     speed_z = SPEED_INITIAL_Z_HZ;
     acceleration_x = ACCELERATION_INITIAL_X_MM_S;
     acceleration_y = ACCELERATION_INITIAL_Y_MM_S;
+    acceleration_z = ACCELERATION_INITIAL_Z_HZ;
+    jerk_xy = JERK_INITIAL_XY_MM_S3;
+
+    // Reset read-ahead
+    command_queue_clear();
+    is_end_of_file = false;
+    x_queued = x_current;
+    y_queued = y_current;
+    speed_xy_queued = SPEED_INITIAL_XY_MM_S;
+    acceleration_x_queued = ACCELERATION_INITIAL_X_MM_S;
+    acceleration_y_queued = ACCELERATION_INITIAL_Y_MM_S;
+    progress_queued = 0;
+    gcode_optimizer_reset();
+    optimizer_dropped_count = 0;
+
+    // Reset job estimate
+    job_estimate_reset(&job_estimate, x_current, y_current, acceleration_x, acceleration_y, acceleration_z,
+        STEPS_PER_REVOLUTION_Z);
+#ifdef S_CURVE_MOVES
+    job_estimate_jerk(&job_estimate, jerk_xy);
+#endif
+    job_duration = 0;
+
+    // Cancel the scan
+    scan_state = SCAN_STATE_NONE;
 }
 
 void gcode_pause(void) {
+#ifdef JUNCTION_DEVIATION
+    // Move that ends with speed decelerates along the next one
+    gcode_brake_on_next_move();
+#endif
+
     // Stop motors
     motors_stop();
 
     // Stop and disable main motor
     motors_stop_z();
     motors_disable_z();
+    is_needle_running = false;
+    is_tension_scheduled = false;
 
     // Reset line condition
     next_line_condition = CONDITION_IMMEDIATELY;
@@ -335,6 +1452,10 @@ void gcode_resume(void) {
     // Reset line condition
     next_line_condition = CONDITION_IMMEDIATELY;
 
+    // Pause decelerates motors, so the last move may not be finished
+    x_current = motors_get_x();
+    y_current = motors_get_y();
+
     // Reset paused_code
     paused_code = 0;
 }
@@ -346,53 +1467,70 @@ void gcode_stop(void) {
     // Stop motors
     motors_abort_and_reset();
 
-    // Set current file position to 0
+    // Set current file position to 0 and drop queued commands
     sd_card_file_rewind();
+    command_queue_clear();
+    is_end_of_file = false;
+    gcode_optimizer_reset();
 
     // Remove thread tension
     servo_set_tension(0);
     is_tensioned = false;
+    is_tension_scheduled = false;
 
     // Stop and disable main motor
     motors_stop_z();
     motors_disable_z();
+    is_needle_running = false;
+
+#ifdef SPEED_GOVERNOR
+    // Next run of the design starts with the settled speed
+    speed_governor_stop();
+#endif
 }
 
-void calculate_interpolation(void) {
+/**
+ * @brief Calculates absolute X and Y distances and total distance (in hundredths of mm) of the move
+ * Axis speed and acceleration are scaled by interpolation_x_d / interpolation_distance (and same for Y)
+ * Moves must be shorter than 460 mm per axis to fit the squares into 32 bits. Speed * steps per mm * axis distance
+ * doesn't fit into 32 bits already at speed * axis length >= ~477000 mm^2/s (at 90 steps/mm), so the axis speeds
+ * are scaled in 64 bits
+ * 
+ * @return boolean - false if there is nothing to move
+ */
+boolean calculate_interpolation(void) {
     // Calculate X distance
-    interpolation_x_d = x_new - motors_get_x();
+    interpolation_x_d = x_new > x_current ? x_new - x_current : x_current - x_new;
 
     // Calculate Y distance
-    interpolation_y_d = y_new - motors_get_y();
+    interpolation_y_d = y_new > y_current ? y_new - y_current : y_current - y_new;
 
     // Find total distance between points
-    interpolation_distance = sqrtf(interpolation_x_d * interpolation_x_d + interpolation_y_d * interpolation_y_d);
-
-    // Calculate X interpolation
-    interpolation_x = abs(interpolation_x_d) / interpolation_distance;
+    interpolation_distance = isqrt32(interpolation_x_d * interpolation_x_d + interpolation_y_d * interpolation_y_d);
 
-    // Calculate Y interpolation
-    interpolation_y = abs(interpolation_y_d) / interpolation_distance;
+    return interpolation_distance > 0;
 }
 
-float gcode_parse_code(char code, float default_value) {
-    // Start at the beginning of buffer
-	char *ptr = sd_card_get_buffer();
-
-    // Walk to the end
-	while ((long)ptr > 1 && (*ptr) && (long)ptr < (long)sd_card_get_buffer() + strlen(sd_card_get_buffer())) {
-        // Convert the digits that follow to a floating point number and return it if the code is found
-		if (*ptr == code)
-			return atof(ptr + 1);
-
-        // Return default value if the comment char is found
-        else if (*ptr == ';')
-            return default_value;
-
-        // Take a step from here to the letter after the next space
-		ptr = strchr(ptr, ' ') + 1;
-	}
-
-    // End reached, nothing found, return default_value.
-	return default_value;
+/**
+ * @brief Returns integer part of the code from the current (tokenized) line
+ * 
+ * @param code - G-code letter
+ * @param default_value - the value to return if the code is not found
+ * @return int32_t - value of the code or default_value
+ */
+int32_t gcode_parse_code(char code, int32_t default_value) {
+    if (words.mask & GCODE_WORD_BIT(code))
+        return words.value[code - 'A'] / GCODE_FIXED_SCALE;
+    return default_value;
 }
+
+/**
+ * @brief Returns fixed-point value of the code from the current (tokenized) line
+ * 
+ * @param code - G-code letter
+ * @param default_value - the value to return if the code is not found (in hundredths)
+ * @return int32_t - value of the code in hundredths or default_value
+ */
+int32_t gcode_parse_fixed(char code, int32_t default_value) {
+    return gcode_parser_get(&words, code, default_value);
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "gcode_parser.hpp"
+
+/**
+ * @brief Converts decimal text to the fixed-point number (hundredths)
+ * The third fractional digit is rounded, the rest are skipped
+ * 
+ * @param ptr - first char of the number (sign or digit)
+ * @param value - parsed value (ex. "-5.678" -> -568)
+ * @return const char* - first char after the number
+ */
+static const char *gcode_parser_parse_fixed(const char *ptr, int32_t *value) {
+    int32_t result = 0;
+    uint8_t digit, fraction_digits = 0;
+    bool negative = false;
+
+    // Sign
+    if (*ptr == '-') {
+        negative = true;
+        ptr++;
+    }
+    else if (*ptr == '+')
+        ptr++;
+
+    // Integer part
+    while ((digit = (uint8_t)(*ptr - '0')) < 10) {
+        result = result * 10 + digit;
+        ptr++;
+    }
+    result *= GCODE_FIXED_SCALE;
+
+    // Fractional part
+    if (*ptr == '.') {
+        ptr++;
+        while ((digit = (uint8_t)(*ptr - '0')) < 10) {
+            if (fraction_digits == 0)
+                result += digit * 10;
+            else if (fraction_digits == 1)
+                result += digit;
+            else if (fraction_digits == 2 && digit >= 5)
+                result++;
+            fraction_digits++;
+            ptr++;
+        }
+    }
+
+    *value = negative ? -result : result;
+    return ptr;
+}
+
+/**
+ * @brief Splits G-code line into words in a single pass
+ * Only the first occurrence of each letter is stored. Parsing stops at the comment char or end of line
+ * 
+ * @param line - null-terminated G-code line
+ * @param words - parsed words (mask and fixed-point values)
+ */
+void gcode_parser_tokenize(const char *line, gcode_words_t *words) {
+    uint8_t index;
+
+    // Reset presence mask
+    words->mask = 0;
+
+    while (*line && *line != ';') {
+        // Index of the letter (wraps around for non-letters)
+        index = (uint8_t)(*line - 'A');
+
+        if (index < GCODE_LETTERS) {
+            // Convert the digits that follow to a fixed-point number
+            if (!(words->mask & ((uint32_t)1 << index))) {
+                line = gcode_parser_parse_fixed(line + 1, &words->value[index]);
+                words->mask |= (uint32_t)1 << index;
+                continue;
+            }
+        }
+
+        // Skip spaces, line endings and repeated letters
+        line++;
+    }
+}
+
+/**
+ * @brief Returns value of the word
+ * 
+ * @param words - parsed words
+ * @param letter - G-code letter ('A' to 'Z')
+ * @param default_value - the value to return if the letter is not found (in hundredths)
+ * @return int32_t - value of the word in hundredths or default_value
+ */
+int32_t gcode_parser_get(const gcode_words_t *words, char letter, int32_t default_value) {
+    if (words->mask & GCODE_WORD_BIT(letter))
+        return words->value[letter - 'A'];
+    return default_value;
+}
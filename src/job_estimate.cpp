@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "job_estimate.hpp"
+
+/**
+ * @brief Calculates duration of the trapezoidal (or triangular) speed profile
+ * With limited jerk (S-curve) the acceleration needs acceleration / jerk to build up and to go down, so the move
+ * takes this time longer (but not more than twice as long)
+ * 
+ * @param estimate - current estimate (caches the factor of the last acceleration, jerk)
+ * @param distance - move length (hundredths of mm, up to UINT16_MAX)
+ * @param speed - maximum speed (mm/s)
+ * @param acceleration - acceleration and deceleration (mm/s^2)
+ * @param entry_speed - speed at the start (mm/s, 0 - from standstill, up to the maximum speed)
+ * @param exit_speed - speed at the end (mm/s, 0 - to standstill, reachable from the entry speed)
+ * @return uint32_t - duration (ms)
+ */
+uint32_t job_estimate_move_duration(job_estimate_t *estimate, uint32_t distance, uint32_t speed,
+                                    uint32_t acceleration, uint32_t entry_speed, uint32_t exit_speed) {
+    uint32_t duration, speed_change;
+    uint64_t peak_square;
+
+    if (speed == 0)
+        return 0;
+
+    // Keeps distance * move_factor in 32 bits
+    if (acceleration < JOB_ESTIMATE_ACCELERATION_MIN)
+        acceleration = JOB_ESTIMATE_ACCELERATION_MIN;
+
+    // Moves through the end points (junction speeds)
+    if (entry_speed > 0 || exit_speed > 0) {
+        // Maximum speed is reached: time at the maximum speed and the time lost while the speed changes,
+        // (speed - entry)^2 / (2 * acceleration * speed) for each end
+        if ((uint64_t)distance * acceleration * 2 >= ((uint64_t)2 * speed * speed - entry_speed * entry_speed
+                                                      - exit_speed * exit_speed) * 100) {
+            speed_change = (speed - entry_speed) * (speed - entry_speed) + (speed - exit_speed) * (speed - exit_speed);
+            duration = distance * 10 / speed + (uint64_t)speed_change * 500 / acceleration / speed;
+        }
+
+        // Accelerates to the peak speed and decelerates: peak^2 = acceleration * distance + (entry^2 + exit^2) / 2
+        // (peak speed in 1/16 mm/s)
+        else {
+            peak_square = ((uint64_t)acceleration * distance / 100 + (entry_speed * entry_speed
+                                                                      + exit_speed * exit_speed) / 2) * 256;
+            speed_change = peak_square <= UINT32_MAX ? isqrt32(peak_square) : (uint32_t)isqrt32(peak_square >> 8) << 4;
+            speed_change = 2 * speed_change > (entry_speed + exit_speed) * 16
+                           ? 2 * speed_change - (entry_speed + exit_speed) * 16 : 0;
+            duration = speed_change * 1000 / 16 / acceleration;
+        }
+    }
+
+    // Maximum speed is reached (acceleration + deceleration distance is speed^2 / acceleration)
+    else if (distance * acceleration >= speed * speed * 100)
+        duration = distance * 10 / speed + speed * 1000 / acceleration;
+
+    // Short moves (all stitches) accelerate to the middle and decelerate: 2 * sqrt(distance / acceleration) s
+    // = sqrt(distance * 640000 / acceleration) / 4 ms, the division is done once per acceleration
+    else {
+        if (acceleration != estimate->move_acceleration) {
+            estimate->move_acceleration = acceleration;
+            estimate->move_factor = 640000 / acceleration;
+        }
+        duration = isqrt32(distance * estimate->move_factor) / 4;
+    }
+
+    // S-curve
+    if (estimate->jerk > 0) {
+        if (acceleration * 1000 / estimate->jerk < duration)
+            return duration + acceleration * 1000 / estimate->jerk;
+        return duration * 2;
+    }
+    return duration;
+}
+
+/**
+ * @brief Calculates duration of one needle revolution until the needle interrupt
+ * Z motor accelerates from standstill, it's stopped after the interrupt while the hoop already moves
+ * 
+ * @param steps - steps per revolution
+ * @param speed - maximum speed (steps/s)
+ * @param acceleration - steps/s^2
+ * @return uint32_t - duration (ms)
+ */
+static uint32_t job_estimate_revolution_duration(uint32_t steps, uint32_t speed, uint32_t acceleration) {
+    if (speed == 0 || acceleration == 0)
+        return 0;
+
+    // Maximum speed is reached (acceleration distance is speed^2 / (2 * acceleration))
+    if (steps * acceleration * 2 >= speed * speed)
+        return steps * 1000 / speed + speed * 500 / acceleration;
+
+    // Acceleration only: sqrt(2 * steps / acceleration) s
+    return isqrt32(2000000 / acceleration * steps);
+}
+
+/**
+ * @brief Starts new estimate
+ * 
+ * @param estimate - estimate to reset
+ * @param x - start position (hundredths of mm)
+ * @param y - start position (hundredths of mm)
+ * @param acceleration_x - initial X acceleration (mm/s^2)
+ * @param acceleration_y - initial Y acceleration (mm/s^2)
+ * @param acceleration_z - initial Z acceleration (steps/s^2)
+ * @param steps_per_revolution - Z motor steps per needle revolution
+ */
+void job_estimate_reset(job_estimate_t *estimate, int32_t x, int32_t y, uint32_t acceleration_x,
+                        uint32_t acceleration_y, uint32_t acceleration_z, uint32_t steps_per_revolution) {
+    estimate->stitch_count = 0;
+    estimate->jump_count = 0;
+    estimate->color_count = 0;
+
+    // Empty bounding box
+    estimate->x_min = INT32_MAX;
+    estimate->y_min = INT32_MAX;
+    estimate->x_max = INT32_MIN;
+    estimate->y_max = INT32_MIN;
+
+    estimate->duration = 0;
+    estimate->last_duration = 0;
+    estimate->move_distance = 0;
+
+    estimate->x = x;
+    estimate->y = y;
+    estimate->acceleration_x = acceleration_x;
+    estimate->acceleration_y = acceleration_y;
+    estimate->acceleration_z = acceleration_z;
+    estimate->jerk = 0;
+    estimate->steps_per_revolution = steps_per_revolution;
+    estimate->exit_speed = 0;
+    estimate->is_move_pending = false;
+
+    // Nothing is cached
+    estimate->move_acceleration = 0;
+    estimate->move_factor = 0;
+    estimate->stitch_speed = 0;
+    estimate->stitch_acceleration = 0;
+    estimate->stitch_duration = 0;
+}
+
+/**
+ * @brief Adds G0/G1 move
+ * Each axis gets speed and acceleration scaled by its part of the distance (same as gcode_execute() does),
+ * so both axes take the time of the whole distance with the acceleration of the slowest moving axis
+ * 
+ * @param estimate - current estimate
+ * @param x - target position (hundredths of mm)
+ * @param y - target position (hundredths of mm)
+ * @param speed - feed rate (mm/s)
+ * @param exit_speed - planned speed at the end point (mm/s, 0 - stop, see gcode_get_junction_speed()), the next
+ * move starts with it
+ */
+void job_estimate_move(job_estimate_t *estimate, int32_t x, int32_t y, uint32_t speed, uint32_t exit_speed) {
+    uint32_t x_d, y_d, distance, acceleration, entry_speed = estimate->exit_speed;
+    uint64_t reachable_square;
+
+    // Update bounding box
+    if (x < estimate->x_min)
+        estimate->x_min = x;
+    if (x > estimate->x_max)
+        estimate->x_max = x;
+    if (y < estimate->y_min)
+        estimate->y_min = y;
+    if (y > estimate->y_max)
+        estimate->y_max = y;
+
+    // Absolute distances
+    x_d = x > estimate->x ? x - estimate->x : estimate->x - x;
+    y_d = y > estimate->y ? y - estimate->y : estimate->y - y;
+    estimate->x = x;
+    estimate->y = y;
+
+    // Zero-length moves are skipped
+    distance = isqrt32(x_d * x_d + y_d * y_d);
+    estimate->move_distance = distance;
+    estimate->last_duration = 0;
+    estimate->exit_speed = 0;
+    if (distance == 0)
+        return;
+
+    // Previous move wasn't followed by a stitch
+    if (estimate->is_move_pending)
+        estimate->jump_count++;
+    estimate->is_move_pending = true;
+
+    // Acceleration of the slowest moving axis
+    acceleration = UINT32_MAX;
+    if (x_d > 0)
+        acceleration = estimate->acceleration_x;
+    if (y_d > 0 && estimate->acceleration_y < acceleration)
+        acceleration = estimate->acceleration_y;
+
+    // Exit speed may not be reached on a short move (the motors continue with the real one)
+    if (entry_speed > speed)
+        entry_speed = speed;
+    if (exit_speed > speed)
+        exit_speed = speed;
+    reachable_square = entry_speed * entry_speed + (uint64_t)2 * acceleration * distance / 100;
+    if (reachable_square < exit_speed * exit_speed)
+        exit_speed = isqrt32(reachable_square);
+    estimate->exit_speed = exit_speed;
+
+    estimate->last_duration = job_estimate_move_duration(estimate, distance, speed, acceleration, entry_speed,
+                                                         exit_speed);
+    estimate->duration += estimate->last_duration;
+}
+
+/**
+ * @brief Adds G4 delay
+ * 
+ * @param estimate - current estimate
+ * @param delay - ms
+ */
+void job_estimate_dwell(job_estimate_t *estimate, uint32_t delay) {
+    estimate->last_duration = delay;
+    estimate->duration += delay;
+}
+
+/**
+ * @brief Adds M0 pause (time of the operator is not counted)
+ * 
+ * @param estimate - current estimate
+ * @param paused_code - M0 C.. code
+ */
+void job_estimate_pause(job_estimate_t *estimate, uint8_t paused_code) {
+    if (paused_code > 0 && paused_code < JOB_ESTIMATE_COLOR_CODE_END)
+        estimate->color_count++;
+}
+
+/**
+ * @brief Adds one stitch (M3 .. I1)
+ * 
+ * @param estimate - current estimate
+ * @param speed - needle speed (steps/s)
+ */
+void job_estimate_stitch(job_estimate_t *estimate, uint32_t speed) {
+    estimate->stitch_count++;
+    estimate->is_move_pending = false;
+
+    // Speed changes rarely, so the duration is calculated once for it
+    if (speed != estimate->stitch_speed || estimate->acceleration_z != estimate->stitch_acceleration) {
+        estimate->stitch_speed = speed;
+        estimate->stitch_acceleration = estimate->acceleration_z;
+        estimate->stitch_duration = job_estimate_revolution_duration(estimate->steps_per_revolution, speed,
+                                                                     estimate->acceleration_z);
+    }
+    estimate->last_duration = estimate->stitch_duration;
+    estimate->duration += estimate->stitch_duration;
+}
+
+/**
+ * @brief Adds M201 acceleration change
+ * 
+ * @param estimate - current estimate
+ * @param acceleration_x - mm/s^2
+ * @param acceleration_y - mm/s^2
+ * @param acceleration_z - steps/s^2
+ */
+void job_estimate_acceleration(job_estimate_t *estimate, uint32_t acceleration_x, uint32_t acceleration_y,
+                               uint32_t acceleration_z) {
+    estimate->acceleration_x = acceleration_x;
+    estimate->acceleration_y = acceleration_y;
+    estimate->acceleration_z = acceleration_z;
+}
+
+/**
+ * @brief Adds M201 J jerk change (only if the moves use S-curves)
+ * 
+ * @param estimate - current estimate
+ * @param jerk - mm/s^3
+ */
+void job_estimate_jerk(job_estimate_t *estimate, uint32_t jerk) {
+    estimate->jerk = jerk;
+}
+
+/**
+ * @brief Completes the estimate after the last command
+ * 
+ * @param estimate - current estimate
+ */
+void job_estimate_finish(job_estimate_t *estimate) {
+    // The last move wasn't followed by a stitch
+    if (estimate->is_move_pending)
+        estimate->jump_count++;
+    estimate->is_move_pending = false;
+
+    // Designs without color changes have one color
+    if (estimate->color_count == 0 && estimate->stitch_count > 0)
+        estimate->color_count = 1;
+
+    // No moves
+    if (estimate->x_min > estimate->x_max) {
+        estimate->x_min = estimate->x;
+        estimate->x_max = estimate->x;
+        estimate->y_min = estimate->y;
+        estimate->y_max = estimate->y;
+    }
+}
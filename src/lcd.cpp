@@ -32,8 +32,13 @@ void lcd_setup(void) {
     serial->println("Initializing LCD");
 #endif
     // Initialize LCD
-    lcd.begin();
-    lcd.noBacklight();
+    lcd_device.begin();
+    lcd_device.noBacklight();
+
+    // LCD is clear after initialization
+    memset(lcd_shown, ' ', sizeof(lcd_shown));
+    lcd_cursor_index = LCD_CURSOR_UNKNOWN;
+    lcd.clear();
 
     // Print startup message
     lcd.print(F("--------------------"));
@@ -44,7 +49,91 @@ void lcd_setup(void) {
     lcd.print(F("Booting up..."));
     lcd.setCursor(0, 3);
     lcd.print(F("--------------------"));
-    lcd.backlight();
+    lcd_flush_all();
+    lcd_device.backlight();
+}
+
+/**
+ * @brief Writes changed cells of the screen to the LCD, continuing from the cell where the last call stopped
+ * The LCD cursor is moved only if the cell doesn't follow the last written one
+ * 
+ * @param cells - maximal number of written characters
+ */
+void lcd_flush(uint8_t cells) {
+    uint8_t row, column;
+
+    if (!is_lcd_changed)
+        return;
+
+    // Each cell is checked once
+    for (uint8_t i = 0; i < LCD_CELLS; i++) {
+        if (cells == 0)
+            return;
+
+        row = lcd_flush_index / LCD_COLUMNS;
+        column = lcd_flush_index % LCD_COLUMNS;
+        if (lcd_screen[row][column] != lcd_shown[row][column]) {
+            if (lcd_cursor_index != lcd_flush_index)
+                lcd_device.setCursor(column, row);
+            lcd_device.write(lcd_screen[row][column]);
+            lcd_shown[row][column] = lcd_screen[row][column];
+            cells--;
+
+            // LCD cursor moves right (the next row doesn't follow the end of the row in the LCD memory)
+            lcd_cursor_index = column + 1 < LCD_COLUMNS ? lcd_flush_index + 1 : LCD_CURSOR_UNKNOWN;
+        }
+        lcd_flush_index = (lcd_flush_index + 1) % LCD_CELLS;
+    }
+
+    // Whole screen is shown
+    is_lcd_changed = false;
+}
+
+/**
+ * @brief Writes all changed cells to the LCD at once (before blocking operations and errors)
+ * 
+ */
+void lcd_flush_all(void) {
+    lcd_flush(LCD_CELLS);
+}
+
+/**
+ * @brief Clears the screen buffer and moves the cursor to the top left cell
+ * 
+ */
+void lcd_buffer_t::clear(void) {
+    memset(lcd_screen, ' ', sizeof(lcd_screen));
+    lcd_column = 0;
+    lcd_row = 0;
+    is_lcd_changed = true;
+}
+
+/**
+ * @brief Moves the cursor of the screen buffer
+ * 
+ * @param column - 0 to 19
+ * @param row - 0 to 3
+ */
+void lcd_buffer_t::setCursor(uint8_t column, uint8_t row) {
+    lcd_column = column;
+    lcd_row = row;
+}
+
+/**
+ * @brief Draws character into the screen buffer and moves the cursor right (characters outside the screen are dropped)
+ * 
+ * @param character - LCD character code
+ * @return size_t - 1
+ */
+size_t lcd_buffer_t::write(uint8_t character) {
+    if (lcd_column < LCD_COLUMNS && lcd_row < LCD_ROWS) {
+        if (lcd_screen[lcd_row][lcd_column] != (char)character) {
+            lcd_screen[lcd_row][lcd_column] = character;
+            is_lcd_changed = true;
+        }
+        lcd_column++;
+    }
+    return 1;
 }
 
 /**
@@ -58,6 +147,9 @@ void lcd_print_error(const char *message) {
     lcd.print(F("Error:"));
     lcd.setCursor(0, 2);
     lcd.print(message);
+
+    // Shown at once (the job waits or stops after an error)
+    lcd_flush_all();
 }
 
 /**
@@ -71,6 +163,9 @@ void lcd_print_error(const __FlashStringHelper *message) {
     lcd.print(F("Error:"));
     lcd.setCursor(0, 2);
     lcd.print(message);
+
+    // Shown at once (the job waits or stops after an error)
+    lcd_flush_all();
 }
 
 void lcd_append_file_top(void) {
@@ -171,14 +266,77 @@ void lcd_print_pre_start(void) {
 
 }
 
+void lcd_print_metadata(file_metadata_t *metadata) {
+    // Clear second row (scan progress)
+    lcd.setCursor(0, 1);
+    lcd.print(F("                    "));
+
+    // Stitches, colors and design size in mm
+    lcd.setCursor(0, 1);
+    lcd.print(metadata->stitch_count);
+    lcd.print(F("st "));
+    lcd.print(metadata->color_count);
+    lcd.print(F("c "));
+    lcd.print(((int32_t)metadata->x_max - metadata->x_min) / 10);
+    lcd.print('x');
+    lcd.print(((int32_t)metadata->y_max - metadata->y_min) / 10);
+    lcd.print(F("mm"));
+
+    // Estimated duration
+    if (metadata->duration > 0) {
+        lcd.setCursor(13, 2);
+        lcd.print('~');
+        lcd_print_duration(metadata->duration);
+    }
+
+    // Design is larger than the hoop
+    if ((int32_t)metadata->x_max - metadata->x_min > HOOP_WIDTH_MM * 10
+        || (int32_t)metadata->y_max - metadata->y_min > HOOP_HEIGHT_MM * 10) {
+        lcd.setCursor(12, 3);
+        lcd.print(F("Too big"));
+    }
+}
+
+/**
+ * @brief Prints progress of the file scan on the pre-start screen
+ * 
+ * @param percent - 0 to 100
+ */
+void lcd_print_scan_progress(uint8_t percent) {
+    lcd.setCursor(0, 1);
+    lcd.print(F("Scanning "));
+    lcd.print(percent);
+    lcd.print(F("%   "));
+}
+
+/**
+ * @brief Prints duration as hours and minutes (5 chars, ex. "1h05m")
+ * 
+ * @param duration - s (negative - unknown)
+ */
+void lcd_print_duration(int32_t duration) {
+    // Unknown or more than 10 hours
+    if (duration < 0 || duration >= 36000L) {
+        lcd.print(F("-----"));
+        return;
+    }
+
+    // Round up to minutes
+    duration = (duration + 59) / 60;
+    lcd.print(duration / 60);
+    lcd.print('h');
+    if (duration % 60 < 10)
+        lcd.print('0');
+    lcd.print(duration % 60);
+    lcd.print('m');
+}
+
 void lcd_print_work(void) {
     lcd.clear();
     lcd_print_file_name();
 
     lcd.setCursor(1, 1);
     lcd.print(F("-------"));
-    lcd.setCursor(14, 1);
-    lcd.print(F("-----"));
     lcd_print_progress();
 
     lcd.setCursor(1, 2);
@@ -192,7 +350,11 @@ void lcd_print_work(void) {
 void lcd_print_progress(void) {
     lcd.setCursor(9, 1);
     lcd.print(gcode_get_progress());
-    lcd.print(F("% ---"));
+    lcd.print(F("%   "));
+
+    // Remaining time
+    lcd.setCursor(14, 1);
+    lcd_print_duration(gcode_get_remaining_time());
 }
 
 void lcd_print_tension(void) {
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "line_ramp.hpp"
+
+/**
+ * @brief Starts the ramp of a new move
+ * 
+ * @param ramp - ramp state
+ * @param velocity_entry - speed at the start (0 - from standstill)
+ * @param velocity_max - speed limit
+ * @param velocity_exit - speed at the end (0 - stop)
+ * @param acceleration - acceleration limit (at least 1)
+ * @param jerk - jerk limit (0 - constant acceleration)
+ */
+void line_ramp_start(line_ramp_t *ramp, uint32_t velocity_entry, uint32_t velocity_max, uint32_t velocity_exit,
+                     uint32_t acceleration, uint32_t jerk) {
+    ramp->phase = LINE_RAMP_PHASE_ACCELERATE;
+    ramp->velocity = velocity_entry;
+    ramp->velocity_max = velocity_max;
+    ramp->velocity_exit = velocity_exit < velocity_max ? velocity_exit : velocity_max;
+    ramp->acceleration_max = acceleration > 0 ? acceleration : 1;
+    ramp->jerk = jerk;
+    ramp->acceleration = 0;
+}
+
+/**
+ * @brief Calculates square root of the ratio
+ * 
+ * @param value - dividend (speed, below 2^24)
+ * @param divisor - divisor (at least 1)
+ * @return uint32_t - sqrt(value / divisor) (1/256)
+ */
+static uint32_t line_ramp_sqrt_ratio(uint32_t value, uint32_t divisor) {
+    uint32_t ratio = (value << 8) / divisor;
+
+    if (ratio < ((uint32_t)1 << 24))
+        return isqrt32(ratio << 8);
+    return (uint32_t)isqrt32(ratio) << 4;
+}
+
+/**
+ * @brief Calculates distance of the S-curve speed change that starts and ends with zero acceleration
+ * 
+ * @param ramp - ramp state
+ * @param velocity - higher speed
+ * @param velocity_exit - lower speed
+ * @return uint64_t - distance (1/65536 of step)
+ */
+static uint64_t line_ramp_s_curve_distance(line_ramp_t *ramp, uint32_t velocity, uint32_t velocity_exit) {
+    uint32_t velocity_change = velocity - velocity_exit, time;
+
+    // Symmetric S-curve runs with the average of both speeds
+    // Acceleration limit is reached: time = change / acceleration + acceleration / jerk (1/256 of slice)
+    if ((uint64_t)velocity_change * ramp->jerk >= (uint64_t)ramp->acceleration_max * ramp->acceleration_max) {
+        time = (velocity_change << 8) / ramp->acceleration_max + (ramp->acceleration_max << 8) / ramp->jerk;
+        return (uint64_t)(velocity + velocity_exit) * time >> 9;
+    }
+
+    // Acceleration only goes up and down: time = 2 * sqrt(change / jerk)
+    return (uint64_t)(velocity + velocity_exit) * line_ramp_sqrt_ratio(velocity_change, ramp->jerk) >> 8;
+}
+
+/**
+ * @brief Calculates distance needed to slow down to the speed with S-curve (exact closed form)
+ * 
+ * @param ramp - ramp state
+ * @param velocity - current speed
+ * @param acceleration - current acceleration (negative while decelerating)
+ * @param velocity_exit - speed at the end
+ * @return uint64_t - distance (1/65536 of step)
+ */
+static uint64_t line_ramp_s_curve_brake(line_ramp_t *ramp, uint32_t velocity, int32_t acceleration,
+                                        uint32_t velocity_exit) {
+    uint32_t value = acceleration >= 0 ? acceleration : -acceleration, time, velocity_change;
+    uint64_t distance, ramp_down;
+
+    // Acceleration goes down to zero in this time (1/256 of slice) and changes the speed by a^2 / 2j
+    time = (value << 8) / ramp->jerk;
+    velocity_change = (uint64_t)value * time >> 9;
+
+    // Speed still goes up meanwhile: distance = t * (v + 2/3 * change)
+    if (acceleration >= 0) {
+        distance = (uint64_t)time * (velocity + velocity_change / 3 * 2) >> 8;
+        velocity += velocity_change;
+        if (velocity <= velocity_exit)
+            return distance;
+        return distance + line_ramp_s_curve_distance(ramp, velocity, velocity_exit);
+    }
+
+    // Deceleration is already too high: it only goes down to zero, distance = t * (v - 2/3 * change)
+    if ((uint64_t)velocity + velocity_change <= velocity_exit + (uint64_t)2 * velocity_change) {
+        ramp_down = velocity_change / 3 * 2;
+        return velocity > ramp_down ? (uint64_t)time * (velocity - ramp_down) >> 8 : 0;
+    }
+
+    // Already decelerating: the rest of the S-curve that started at the peak speed with zero acceleration
+    // (the part already done is t * (peak - 1/3 * change))
+    velocity += velocity_change;
+    distance = line_ramp_s_curve_distance(ramp, velocity, velocity_exit);
+    ramp_down = (uint64_t)time * (velocity - velocity_change / 3) >> 8;
+    return distance > ramp_down ? distance - ramp_down : 0;
+}
+
+/**
+ * @brief Returns lead axis steps needed to slow down from the current state to the speed
+ * With S-curve the current acceleration first goes down to zero, which still adds speed
+ * 
+ * @param ramp - ramp state
+ * @param velocity_exit - speed at the end
+ * @return uint32_t - steps
+ */
+uint32_t line_ramp_brake_steps(line_ramp_t *ramp, uint32_t velocity_exit) {
+    uint32_t velocity;
+
+    // Constant acceleration (speeds in 1/256 of step per slice, so the squares fit into 32 bits)
+    if (ramp->jerk == 0) {
+        velocity = ramp->velocity >> 8;
+        velocity_exit >>= 8;
+        if (velocity <= velocity_exit)
+            return 0;
+        return (velocity * velocity - velocity_exit * velocity_exit) / (2 * ramp->acceleration_max);
+    }
+
+    return (line_ramp_s_curve_brake(ramp, ramp->velocity, ramp->acceleration, velocity_exit)
+            + (1 << LINE_RAMP_FRACTION_BITS) - 1) >> LINE_RAMP_FRACTION_BITS;
+}
+
+/**
+ * @brief Returns speed changed while the acceleration goes down to zero by jerk steps
+ * 
+ * @param ramp - ramp state
+ * @param acceleration - acceleration (or deceleration)
+ * @return uint32_t - speed change
+ */
+static uint32_t line_ramp_ramp_down_change(line_ramp_t *ramp, uint32_t acceleration) {
+    uint32_t count = acceleration / ramp->jerk;
+
+    // (a - j) + (a - 2j) + ... + (a - nj)
+    return (uint64_t)count * acceleration - (uint64_t)ramp->jerk * count * (count + 1) / 2;
+}
+
+/**
+ * @brief Checks if the acceleration keeps the speed between the limits
+ * The speed has to stay inside when the acceleration later goes down to zero by jerk steps
+ * 
+ * @param ramp - ramp state
+ * @param acceleration - acceleration of the next slice
+ * @param velocity_min - lowest speed before the last step
+ * @return bool - true if the limits are kept
+ */
+static bool line_ramp_is_in_limits(line_ramp_t *ramp, int32_t acceleration, uint32_t velocity_min) {
+    if (acceleration >= 0)
+        return (uint64_t)ramp->velocity + acceleration + line_ramp_ramp_down_change(ramp, acceleration)
+               <= ramp->velocity_max;
+    return ramp->velocity >= (uint64_t)velocity_min + (uint32_t)-acceleration
+                             + line_ramp_ramp_down_change(ramp, -acceleration);
+}
+
+/**
+ * @brief Changes acceleration of the S-curve for one slice
+ * The plan is made again every slice: the highest acceleration (more by jerk, same or less by jerk) is taken,
+ * which keeps the speed limits and still leaves the distance to slow down to the exit speed
+ * 
+ * @param ramp - ramp state
+ * @param remaining - distance to the end of the move (1/65536 of step)
+ * @param velocity_min - lowest speed before the last step
+ */
+static void line_ramp_s_curve_step(line_ramp_t *ramp, uint64_t remaining, uint32_t velocity_min) {
+    int32_t acceleration = ramp->acceleration, jerk = ramp->jerk, limit = ramp->acceleration_max;
+    int32_t candidates[3], selected = acceleration;
+    uint32_t velocity;
+    bool is_selected = false;
+
+    candidates[0] = acceleration + jerk < limit ? acceleration + jerk : limit;
+    candidates[1] = acceleration;
+    candidates[2] = acceleration - jerk > -limit ? acceleration - jerk : -limit;
+
+    for (uint8_t i = 0; i < 3 && !is_selected; i++) {
+        if (!line_ramp_is_in_limits(ramp, candidates[i], velocity_min))
+            continue;
+
+        // The last one in the limits brakes the hardest, it is taken when none fits into the distance
+        selected = candidates[i];
+        if (i == 2)
+            break;
+        velocity = ramp->velocity + candidates[i];
+        is_selected = line_ramp_s_curve_brake(ramp, velocity, candidates[i], velocity_min)
+                      + (ramp->velocity + velocity) / 2 <= remaining;
+    }
+
+    // Never stand still before the end
+    if (ramp->velocity + selected == 0)
+        selected = jerk < limit ? jerk : limit;
+
+    ramp->acceleration = selected;
+    ramp->velocity += selected;
+    ramp->phase = selected > 0 ? LINE_RAMP_PHASE_ACCELERATE
+                               : selected < 0 ? LINE_RAMP_PHASE_DECELERATE : LINE_RAMP_PHASE_COAST;
+}
+
+/**
+ * @brief Speeds up (or keeps the maximum speed) for one slice with constant acceleration
+ * 
+ * @param ramp - ramp state
+ */
+static void line_ramp_accelerate(line_ramp_t *ramp) {
+    if (ramp->velocity < ramp->velocity_max)
+        ramp->velocity += ramp->acceleration_max;
+
+    if (ramp->velocity >= ramp->velocity_max) {
+        ramp->velocity = ramp->velocity_max;
+        ramp->phase = LINE_RAMP_PHASE_COAST;
+    }
+}
+
+/**
+ * @brief Calculates speed of the next slice
+ * 
+ * @param ramp - ramp state
+ * @param remaining - lead axis steps to the end of the move
+ * @return uint32_t - average speed of the slice
+ */
+uint32_t line_ramp_next(line_ramp_t *ramp, uint32_t remaining) {
+    uint32_t velocity_previous = ramp->velocity, velocity_min;
+
+    // Keep the exit speed (or minimal speed) until the last step
+    velocity_min = ramp->velocity_exit > ramp->acceleration_max ? ramp->velocity_exit : ramp->acceleration_max;
+
+    // S-curve
+    if (ramp->jerk != 0) {
+        line_ramp_s_curve_step(ramp, (uint64_t)remaining << LINE_RAMP_FRACTION_BITS, velocity_min);
+        return (velocity_previous + ramp->velocity) / 2;
+    }
+
+    // Constant acceleration
+    if (ramp->phase != LINE_RAMP_PHASE_DECELERATE && remaining <= line_ramp_brake_steps(ramp, ramp->velocity_exit))
+        ramp->phase = LINE_RAMP_PHASE_DECELERATE;
+
+    switch (ramp->phase)
+    {
+        case LINE_RAMP_PHASE_ACCELERATE:
+            line_ramp_accelerate(ramp);
+            break;
+
+        case LINE_RAMP_PHASE_DECELERATE:
+            if (ramp->velocity > velocity_min + ramp->acceleration_max)
+                ramp->velocity -= ramp->acceleration_max;
+            else
+                ramp->velocity = velocity_min;
+            break;
+
+        default:
+            break;
+    }
+
+    return (velocity_previous + ramp->velocity) / 2;
+}
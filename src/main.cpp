@@ -28,6 +28,104 @@ volatile uint8_t system_state;
 HardwareSerial* serial;
 #endif
 
+// Job is running (tick budget applies)
+boolean is_job_running() {
+  return system_state == STATE_WORK || system_state == STATE_TENSION_SETUP;
+}
+
+// Motion task: returns true if a job command was executed (the next one may be ready, other tasks wait)
+boolean task_motion() {
+  // Feed coordinated move of the hoop
+  motors_update();
+
+  // Z position of the last needle pulse
+  needle_sensor_update();
+
+#ifdef DC_MAIN_MOTOR
+  // Control speed of the main motor
+  speed_controller_update();
+#endif
+
+  // Execute job commands
+  if (is_job_running())
+    return gcode_cycle();
+  return false;
+}
+
+// Read-ahead task: reads one line (or record) of the job file into the command queue
+boolean task_read_ahead() {
+  if (is_job_running())
+    gcode_read_ahead();
+
+#ifdef JOB_PRE_SCAN
+  // Pre-scan of the selected file in slices (the pre-start menu shows the progress)
+  else
+    gcode_scan_step();
+#endif
+  return false;
+}
+
+// UI task: menus and LCD
+boolean task_ui() {
+  switch (system_state)
+  {
+  case STATE_PRE_START:
+    // Pre-start menu
+    menu_pre_start();
+    break;
+
+  case STATE_WORK:
+    // Working
+    menu_work();
+    break;
+
+  case STATE_TENSION_SETUP:
+    // Tension setup during the work
+    menu_tension();
+    break;
+
+  case STATE_PAUSE:
+    // Pause
+    menu_pause();
+    break;
+
+  case STATE_STOP_CONFIRMATION:
+    // Stop confirmation
+    menu_stop_confirmation();
+    break;
+  
+  default:
+    // SD-card menu
+    menu_sd_card();
+    break;
+  }
+  return false;
+}
+
+// LCD task: writes a few changed characters of the screen to the LCD
+boolean task_lcd() {
+  lcd_flush(LCD_FLUSH_CELLS);
+  return false;
+}
+
+#ifdef DEBUG
+// Log task: worst-case execution times (us) and runs held back by the budget of all tasks during the job
+boolean task_log() {
+  if (!is_job_running())
+    return false;
+
+  serial->print(F("Tasks WCET/skipped:"));
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    serial->print(' ');
+    serial->print(scheduler_get_wcet(i));
+    serial->print('/');
+    serial->print(scheduler_get_skipped_count(i));
+  }
+  serial->println();
+  return false;
+}
+#endif
+
 void setup() {
   // Initialize debug serial port
 #ifdef DEBUG
@@ -53,11 +151,18 @@ void setup() {
   // Initialize needle sensor
   needle_sensor_setup();
 
+#ifdef Z_STOP_COMPENSATION
+  // Read learned stops of the main motor
+  z_stop_table_load();
+#endif
+
   // Initialize servo
   servo_setup();
 
-  // Initialize speed controller
-  //speed_controller_setup();
+#ifdef DC_MAIN_MOTOR
+  // Initialize speed controller of the DC main motor
+  speed_controller_setup();
+#endif
 
   // Initialize gcode handler
   gcode_clear();
@@ -71,8 +176,8 @@ void setup() {
     while (1);
   }
 
-  // Count number of files on SD card
-  sd_card_count_files();
+  // Build sorted index of files on SD card
+  sd_card_build_index();
 
   // Wait some time to finish initialization (also, delay for startup message)
   delay(500);
@@ -83,39 +188,18 @@ void setup() {
 
   // Show SD-card menu
   menu_sd_card_init();
+
+  // Tasks of loop() in priority order
+  scheduler_set_task(TASK_MOTION, task_motion, 0);
+  scheduler_set_task(TASK_READ_AHEAD, task_read_ahead, 0);
+  scheduler_set_task(TASK_UI, task_ui, SCHEDULER_UI_PERIOD_MS);
+  scheduler_set_task(TASK_LCD, task_lcd, 0);
+#ifdef DEBUG
+  scheduler_set_task(TASK_LOG, task_log, SCHEDULER_LOG_PERIOD_MS);
+#endif
 }
 
 void loop() {
-  switch (system_state)
-  {
-  case STATE_PRE_START:
-    // Pre-start menu
-    menu_pre_start();
-    break;
-
-  case STATE_WORK:
-  case STATE_TENSION_SETUP:
-    // Working
-    gcode_cycle();
-    if (system_state == STATE_TENSION_SETUP)
-      menu_tension();
-    else
-      menu_work();
-    break;
-
-  case STATE_PAUSE:
-    // Pause
-    menu_pause();
-    break;
-
-  case STATE_STOP_CONFIRMATION:
-    // Stop confirmation
-    menu_stop_confirmation();
-    break;
-  
-  default:
-    // SD-card menu
-    menu_sd_card();
-    break;
-  }
+  // Motion first, then read-ahead, UI and debug log (held back by the tick budget during the job)
+  scheduler_tick(is_job_running());
 }
@@ -29,18 +29,14 @@
  * 
  */
 void menu_sd_card_init(void) {
-    // Add first files
-    while(sd_card_read_prev_file())
-        lcd_append_file_top();
+    // Add first files (the newest one on the top)
+    for (uint32_t i = min(sd_card_get_number_of_files(), 4UL); i > 0; i--)
+        if (sd_card_select_file(i - 1))
+            lcd_append_file_top();
 
     // Select first file
     lcd_print_cursor(0);
-
-    // Reset files counter
-    sd_card_reset_files();
-
-    // Select first file
-    sd_card_read_next_file();
+    sd_card_select_file(0);
 }
 
 
@@ -57,7 +53,7 @@ void menu_sd_card(void) {
         // Scroll to the bottom (next file)
         if (menu_encoder_counter_temp > menu_encoder_counter) {
 
-            if (file_index < sd_card_get_number_of_files() - 1) {
+            if (file_index + 1 < sd_card_get_number_of_files()) {
                 // Read next file
                 sd_card_read_next_file();
                 file_index++;
@@ -107,6 +103,23 @@ void menu_sd_card(void) {
 
         // Draw pre-start menu
         lcd_print_pre_start();
+
+        // Get design information (read or scanned from the file once, then stored in the index file)
+        is_file_metadata_known = sd_card_get_metadata(&file_metadata);
+#ifdef JOB_PRE_SCAN
+        // Scan is done by the read-ahead task in slices, menu_pre_start() shows the progress
+        if (!is_file_metadata_known && gcode_scan_start()) {
+            scan_progress = 0;
+            lcd_print_scan_progress(scan_progress);
+        }
+#else
+        if (!is_file_metadata_known && gcode_read_metadata(&file_metadata)) {
+            sd_card_set_metadata(&file_metadata);
+            is_file_metadata_known = true;
+        }
+#endif
+        if (is_file_metadata_known)
+            lcd_print_metadata(&file_metadata);
         sub_menu_cursor = 2;
         lcd_print_cursor(sub_menu_cursor);
 
@@ -116,6 +129,21 @@ void menu_sd_card(void) {
 }
 
 void menu_pre_start(void) {
+#ifdef JOB_PRE_SCAN
+    // Scan of the file is finished -> store and show the results, otherwise update the progress
+    if (gcode_is_scanning()) {
+        if (gcode_scan_finish(&file_metadata)) {
+            sd_card_set_metadata(&file_metadata);
+            is_file_metadata_known = true;
+            lcd_print_metadata(&file_metadata);
+        }
+        else if (gcode_get_scan_progress() != scan_progress) {
+            scan_progress = gcode_get_scan_progress();
+            lcd_print_scan_progress(scan_progress);
+        }
+    }
+#endif
+
     // Get current encoder state
     menu_encoder_counter_temp = encoder_get_counter();
 
@@ -141,17 +169,38 @@ void menu_pre_start(void) {
             // Reset gcode variables
             gcode_clear();
 
-            // Draw work menu
-            lcd_print_work();
-            sub_menu_cursor = 2;
-            lcd_print_cursor(sub_menu_cursor);
+            // Open file (read header of binary files)
+            if (gcode_start()) {
+                // Remaining time is counted from the estimated duration
+                gcode_set_duration(is_file_metadata_known ? file_metadata.duration : 0);
 
-            // Set system state to working
-            system_state = STATE_WORK;
+                // Draw work menu
+                lcd_print_work();
+                sub_menu_cursor = 2;
+                lcd_print_cursor(sub_menu_cursor);
+
+                // Set system state to working
+                system_state = STATE_WORK;
+
+                // Drawing of the menus before the job doesn't count into the budget of the UI task
+                scheduler_reset_statistics();
+            }
+
+            // Wrong file -> show error and return to main menu
+            else {
+                lcd_print_error(F("Wrong file format"));
+                delay(2000);
+                system_state = STATE_SD_MENU;
+                lcd_print_selector();
+                lcd_print_cursor(selector_cursor);
+            }
         }
 
         // Go back
         else {
+            // Cancel the scan
+            gcode_clear();
+
             // Return to main menu
             system_state = STATE_SD_MENU;
             lcd_print_selector();
@@ -203,6 +252,12 @@ void menu_work(void) {
         // Clear button flag
         encoder_clear_button_flag();
     }
+
+    // Progress changed by the job (drawn here, so the motion task doesn't wait for the LCD)
+    if (gcode_get_progress_flag()) {
+        lcd_print_progress();
+        gcode_clear_progress_flag();
+    }
 }
 
 void menu_tension(void) {
@@ -240,9 +295,29 @@ void menu_tension(void) {
         // Clear button flag
         encoder_clear_button_flag();
     }
+
+    // Progress changed by the job (drawn here, so the motion task doesn't wait for the LCD)
+    if (gcode_get_progress_flag()) {
+        lcd_print_progress();
+        gcode_clear_progress_flag();
+    }
 }
 
 void menu_pause(void) {
+    // Error stays on the screen for a while (or until the button is pressed), then the pause menu is drawn
+    if (is_pause_error_shown) {
+        if (millis() - pause_error_timer < LCD_ERROR_TIME_MS && !encoder_get_button_flag())
+            return;
+        is_pause_error_shown = false;
+        encoder_clear_button_flag();
+        menu_encoder_counter = encoder_get_counter();
+
+        sub_menu_cursor = 2;
+        lcd_print_pause();
+        lcd_print_cursor(sub_menu_cursor);
+        return;
+    }
+
     // Get current encoder state
     menu_encoder_counter_temp = encoder_get_counter();
 
@@ -335,6 +410,18 @@ void menu_stop_confirmation(void) {
 }
 
 void menu_stop_file(void) {
+#ifdef DEBUG
+    serial->print(F("SD read speed: "));
+    serial->print(sd_card_get_read_speed());
+    serial->println(F(" B/s"));
+    serial->print(F("Needle pulses missed: "));
+    serial->print(needle_sensor_get_missed_count());
+    serial->print(F(", double: "));
+    serial->println(needle_sensor_get_double_count());
+    serial->print(F("Z steps per revolution: "));
+    serial->println(needle_sensor_get_steps_per_revolution());
+#endif
+
     // Stop current work
     gcode_stop();
 
@@ -359,3 +446,21 @@ void menu_pause_file(void) {
     lcd_print_pause();
     lcd_print_cursor(sub_menu_cursor);
 }
+
+/**
+ * @brief Pauses the job because of an error, the error is shown first (by menu_pause())
+ * 
+ * @param message - error message
+ */
+void menu_pause_file_error(const __FlashStringHelper *message) {
+    // Change system_state to pause
+    system_state = STATE_PAUSE;
+
+    // Pause current work
+    gcode_pause();
+
+    // Print error instead of the pause menu for a while
+    lcd_print_error(message);
+    is_pause_error_shown = true;
+    pause_error_timer = millis();
+}
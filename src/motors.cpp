@@ -50,112 +50,459 @@ boolean motors_setup() {
     motors_disable();
     stepper_z->disableOutputs();
 
+    // No move is started
+    move_state = MOVE_STATE_DONE;
+
     // Set default speed and acceleration
-    stepper_x->setSpeedInHz(SPEED_INITIAL_XY_MM_S * STEPS_PER_MM_X);
-    stepper_y->setSpeedInHz(SPEED_INITIAL_XY_MM_S * STEPS_PER_MM_Y);
-    stepper_z->setSpeedInHz(SPEED_INITIAL_Z_HZ);
-    stepper_x->setAcceleration(ACCELERATION_INITIAL_X_MM_S * STEPS_PER_MM_X);
-    stepper_y->setAcceleration(ACCELERATION_INITIAL_Y_MM_S * STEPS_PER_MM_Y);
-    stepper_z->setAcceleration(ACCELERATION_INITIAL_Z_HZ);
+    motor_speed_x = SPEED_INITIAL_XY_MM_S * STEPS_PER_MM_X;
+    motor_speed_y = SPEED_INITIAL_XY_MM_S * STEPS_PER_MM_Y;
+    motor_speed_z = SPEED_INITIAL_Z_HZ;
+    motor_acceleration_x = ACCELERATION_INITIAL_X_MM_S * STEPS_PER_MM_X;
+    motor_acceleration_y = ACCELERATION_INITIAL_Y_MM_S * STEPS_PER_MM_Y;
+    motor_acceleration_z = ACCELERATION_INITIAL_Z_HZ;
+    stepper_x->setSpeedInHz(motor_speed_x);
+    stepper_y->setSpeedInHz(motor_speed_y);
+    stepper_z->setSpeedInHz(motor_speed_z);
+    stepper_x->setAcceleration(motor_acceleration_x);
+    stepper_y->setAcceleration(motor_acceleration_y);
+    stepper_z->setAcceleration(motor_acceleration_z);
     
     // Return successful value
     return true;
 }
 
+/**
+ * @brief Converts position in hundredths of mm to steps (rounded to the nearest step)
+ * 
+ * @param position - position in hundredths of mm
+ * @param steps_per_mm - STEPS_PER_MM_X or STEPS_PER_MM_Y
+ * @return int32_t - position in steps
+ */
+int32_t motors_fixed_to_steps(int32_t position, int32_t steps_per_mm) {
+    position *= steps_per_mm;
+    return (position + (position < 0 ? -GCODE_FIXED_SCALE / 2 : GCODE_FIXED_SCALE / 2)) / GCODE_FIXED_SCALE;
+}
+
+/**
+ * @brief Converts position in steps to hundredths of mm (rounded to the nearest hundredth)
+ * 
+ * @param steps - position in steps
+ * @param steps_per_mm - STEPS_PER_MM_X or STEPS_PER_MM_Y
+ * @return int32_t - position in hundredths of mm
+ */
+int32_t motors_steps_to_fixed(int32_t steps, int32_t steps_per_mm) {
+    steps *= GCODE_FIXED_SCALE;
+    return (steps + (steps < 0 ? -steps_per_mm / 2 : steps_per_mm / 2)) / steps_per_mm;
+}
+
 /**
  * @brief Gets current x motor position
  * 
- * @return float - motor position in mm
+ * @return int32_t - motor position in hundredths of mm
  */
-float motors_get_x() {
-    return (float)stepper_x->getCurrentPosition() / (float)STEPS_PER_MM_X;
+int32_t motors_get_x() {
+    return motors_steps_to_fixed(stepper_x->getCurrentPosition(), STEPS_PER_MM_X);
 }
 
 /**
  * @brief Gets current y motor position
  * 
- * @return float - motor position in mm
+ * @return int32_t - motor position in hundredths of mm
  */
-float motors_get_y() {
-    return (float)stepper_y->getCurrentPosition() / (float)STEPS_PER_MM_Y;
+int32_t motors_get_y() {
+    return motors_steps_to_fixed(stepper_y->getCurrentPosition(), STEPS_PER_MM_Y);
 }
 
 /**
- * @brief Sets X motor speed
+ * @brief Sets X motor speed (the same value is not written again)
  * 
- * @param speed_mm_s - speed in mm/s
+ * @param speed_hz - speed in steps/s
  */
-void motors_set_speed_x(float speed_mm_s) {
-    stepper_x->setSpeedInHz(speed_mm_s * STEPS_PER_MM_X);
+void motors_set_speed_x(uint32_t speed_hz) {
+    if (speed_hz == motor_speed_x)
+        return;
+    motor_speed_x = speed_hz;
+    stepper_x->setSpeedInHz(speed_hz);
 }
 
 /**
- * @brief Sets Y motor speed
+ * @brief Sets Y motor speed (the same value is not written again)
  * 
- * @param speed_mm_s - speed in mm/s
+ * @param speed_hz - speed in steps/s
  */
-void motors_set_speed_y(float speed_mm_s) {
-    stepper_y->setSpeedInHz(speed_mm_s * STEPS_PER_MM_Y);
+void motors_set_speed_y(uint32_t speed_hz) {
+    if (speed_hz == motor_speed_y)
+        return;
+    motor_speed_y = speed_hz;
+    stepper_y->setSpeedInHz(speed_hz);
 }
 
 /**
- * @brief Sets Z motor speed
+ * @brief Sets Z motor speed (the same value is not written again)
  * 
  * @param speed_hz - speed in steps/s
  */
 void motors_set_speed_z(uint32_t speed_hz) {
+    if (speed_hz == motor_speed_z)
+        return;
+    motor_speed_z = speed_hz;
+#ifdef DC_MAIN_MOTOR
+    speed_controller_set_speed(speed_hz);
+#else
     stepper_z->setSpeedInHz(speed_hz);
+#endif
 }
 
 /**
- * @brief Sets X motor acceleration
+ * @brief Sets X motor acceleration (the same value is not written again)
  * 
- * @param acceleration_mm_s - acceleration in mm/s^2
+ * @param acceleration_steps_s - acceleration in steps/s^2
  */
-void motors_set_acceleration_x(float acceleration_mm_s) {
-    stepper_x->setAcceleration(acceleration_mm_s * STEPS_PER_MM_X);
+void motors_set_acceleration_x(int32_t acceleration_steps_s) {
+    if (acceleration_steps_s == motor_acceleration_x)
+        return;
+    motor_acceleration_x = acceleration_steps_s;
+    stepper_x->setAcceleration(acceleration_steps_s);
 }
 
 /**
- * @brief Sets Y motor acceleration
+ * @brief Sets Y motor acceleration (the same value is not written again)
  * 
- * @param acceleration_mm_s - acceleration in mm/s^2
+ * @param acceleration_steps_s - acceleration in steps/s^2
  */
-void motors_set_acceleration_y(float acceleration_mm_s) {
-    stepper_y->setAcceleration(acceleration_mm_s * STEPS_PER_MM_Y);
+void motors_set_acceleration_y(int32_t acceleration_steps_s) {
+    if (acceleration_steps_s == motor_acceleration_y)
+        return;
+    motor_acceleration_y = acceleration_steps_s;
+    stepper_y->setAcceleration(acceleration_steps_s);
 }
 
 /**
- * @brief Sets Z motor acceleration
+ * @brief Sets Z motor acceleration (the same value is not written again)
  * 
  * @param acceleration_steps_s - acceleration in steps/s^2
  */
 void motors_set_acceleration_z(int32_t acceleration_steps_s) {
+    if (acceleration_steps_s == motor_acceleration_z)
+        return;
+    motor_acceleration_z = acceleration_steps_s;
+#ifdef DC_MAIN_MOTOR
+    speed_controller_set_acceleration(acceleration_steps_s);
+#else
     stepper_z->setAcceleration(acceleration_steps_s);
+#endif
 }
 
 /**
- * @brief Starts moving to absolute position
- * Attention! Blocks the thread until the steppers start moving
+ * @brief Starts moving to absolute position (doesn't wait for the motors, see motors_get_move_state())
  * 
- * @param x - new absolute X position in mm
- * @param y - new absolute Y position in mm
+ * @param x - new absolute X position in hundredths of mm
+ * @param y - new absolute Y position in hundredths of mm
  */
-void motors_move_to_position(float *x, float *y) {
+void motors_move_to_position(int32_t x, int32_t y) {
     // Calculate new position in steps
-    new_position_x_steps = *x * (float)STEPS_PER_MM_X;
-    new_position_y_steps = *y * (float)STEPS_PER_MM_Y;
-
-    // Check if it is a new position
-    if (new_position_x_steps != stepper_x->getCurrentPosition()
-        || new_position_y_steps != stepper_y->getCurrentPosition()) {
-            // Move to new position
-            stepper_x->moveTo(new_position_x_steps);
-            stepper_y->moveTo(new_position_y_steps);
-
-            // Wait for stepper to start moving
-            while (!stepper_x->isRunning() && !stepper_y->isRunning());
+    new_position_x_steps = motors_fixed_to_steps(x, STEPS_PER_MM_X);
+    new_position_y_steps = motors_fixed_to_steps(y, STEPS_PER_MM_Y);
+
+    // Already there
+    if (new_position_x_steps == stepper_x->getCurrentPosition()
+        && new_position_y_steps == stepper_y->getCurrentPosition()) {
+        move_state = MOVE_STATE_DONE;
+        return;
+    }
+
+    // Move to new position
+    move_start_time = millis();
+    if (stepper_x->moveTo(new_position_x_steps) != MOVE_OK || stepper_y->moveTo(new_position_y_steps) != MOVE_OK)
+        move_state = MOVE_STATE_REJECTED;
+    else
+        move_state = MOVE_STATE_QUEUED;
+}
+
+/**
+ * @brief Updates and returns state of the last started move (call from the loop instead of waiting)
+ * Queued move is done when both motors are at the target (short moves can finish between two calls)
+ * 
+ * @return uint8_t - MOVE_STATE_...
+ */
+uint8_t motors_get_move_state(void) {
+    boolean is_running = stepper_x->isRunning() || stepper_y->isRunning();
+
+#ifdef COORDINATED_MOVES
+    // Steps of the coordinated move are still being queued
+    if (is_line_active)
+        is_running = true;
+#endif
+
+    switch (move_state)
+    {
+        case MOVE_STATE_QUEUED:
+            if (is_running)
+                move_state = MOVE_STATE_RUNNING;
+            else if (stepper_x->getCurrentPosition() == new_position_x_steps
+                     && stepper_y->getCurrentPosition() == new_position_y_steps)
+                move_state = MOVE_STATE_DONE;
+            else if (millis() - move_start_time >= MOTORS_MOVE_START_TIMEOUT)
+                move_state = MOVE_STATE_REJECTED;
+            break;
+
+        case MOVE_STATE_RUNNING:
+            if (!is_running)
+                move_state = MOVE_STATE_DONE;
+            break;
+
+        default:
+            break;
+    }
+    return move_state;
+}
+
+/**
+ * @brief Starts coordinated move to absolute position (COORDINATED_MOVES)
+ * Both axes follow one speed ramp along the line, so they start and finish together.
+ * If the previous move ends with speed and its steps are still running, this move continues with that speed
+ * Attention! Call motors_update() from the loop until the move is finished
+ * 
+ * @param x - new absolute X position in hundredths of mm
+ * @param y - new absolute Y position in hundredths of mm
+ * @param distance - length of the move in hundredths of mm
+ * @param speed - speed along the line (mm/s)
+ * @param acceleration - acceleration along the line (mm/s^2)
+ * @param jerk - jerk along the line (mm/s^3, 0 - constant acceleration)
+ * @param exit_speed - speed at the end of the move (mm/s, 0 - stop), the next move must follow without waiting
+ */
+void motors_move_line(int32_t x, int32_t y, uint32_t distance, uint32_t speed, uint32_t acceleration,
+    uint32_t jerk, uint32_t exit_speed) {
+    int32_t steps_x, steps_y;
+    uint32_t steps_per_mm_remainder, speed_steps, acceleration_steps, jerk_steps, entry_steps = 0;
+    uint32_t velocity_max, velocity_exit, acceleration_slice;
+    boolean is_running = stepper_x->isRunning() || stepper_y->isRunning();
+
+    // Steps of both axes (from the end of the queued steps)
+    new_position_x_steps = motors_fixed_to_steps(x, STEPS_PER_MM_X);
+    new_position_y_steps = motors_fixed_to_steps(y, STEPS_PER_MM_Y);
+    steps_x = new_position_x_steps - stepper_x->getPositionAfterCommandsCompleted();
+    steps_y = new_position_y_steps - stepper_y->getPositionAfterCommandsCompleted();
+    if ((steps_x == 0 && steps_y == 0) || distance == 0) {
+        // Don't let the previous move run out of queued steps with speed
+        if (is_running)
+            motors_line_brake();
+        else
+            move_state = MOVE_STATE_DONE;
+        return;
+    }
+    move_start_time = millis();
+    move_state = MOVE_STATE_QUEUED;
+
+    // Axis with more steps leads
+    if (abs(steps_x) >= abs(steps_y)) {
+        line_lead = stepper_x;
+        line_follower = stepper_y;
+        line_steps_lead = abs(steps_x);
+        line_steps_follower = abs(steps_y);
+        is_line_lead_count_up = steps_x > 0;
+        is_line_follower_count_up = steps_y > 0;
+        line_carry_lead = &line_carry_x;
+        line_carry_follower = &line_carry_y;
+    }
+    else {
+        line_lead = stepper_y;
+        line_follower = stepper_x;
+        line_steps_lead = abs(steps_y);
+        line_steps_follower = abs(steps_x);
+        is_line_lead_count_up = steps_y > 0;
+        is_line_follower_count_up = steps_x > 0;
+        line_carry_lead = &line_carry_y;
+        line_carry_follower = &line_carry_x;
+    }
+
+    // Lead axis steps per mm of the line (integer and fractional parts)
+    line_steps_per_mm = line_steps_lead * GCODE_FIXED_SCALE / distance;
+    steps_per_mm_remainder = line_steps_lead * GCODE_FIXED_SCALE % distance;
+
+    // Speed (steps/s) and acceleration (steps/s^2) of the lead axis
+    speed_steps = speed * line_steps_per_mm + speed * steps_per_mm_remainder / distance;
+    if (speed_steps > (uint32_t)MOTORS_LINE_MAX_STEPS_PER_SLICE * MOTORS_LINE_SLICES_PER_S)
+        speed_steps = (uint32_t)MOTORS_LINE_MAX_STEPS_PER_SLICE * MOTORS_LINE_SLICES_PER_S;
+    acceleration_steps = acceleration * line_steps_per_mm + acceleration * steps_per_mm_remainder / distance;
+    if (acceleration_steps > MOTORS_LINE_MAX_ACCELERATION)
+        acceleration_steps = MOTORS_LINE_MAX_ACCELERATION;
+
+    // Jerk (steps/s^3) of the lead axis
+    if (jerk > MOTORS_LINE_MAX_JERK)
+        jerk = MOTORS_LINE_MAX_JERK;
+    jerk_steps = jerk * line_steps_per_mm + jerk * steps_per_mm_remainder / distance;
+
+    // Same in 1/65536 of step per slice (per slice^2, per slice^3)
+    velocity_max = (speed_steps << LINE_RAMP_FRACTION_BITS) / MOTORS_LINE_SLICES_PER_S;
+    acceleration_slice = acceleration_steps * ((uint32_t)1 << (LINE_RAMP_FRACTION_BITS - 2))
+        / ((uint32_t)MOTORS_LINE_SLICES_PER_S * MOTORS_LINE_SLICES_PER_S / 4);
+    jerk_steps = jerk_steps / ((uint32_t)MOTORS_LINE_SLICES_PER_S * MOTORS_LINE_SLICES_PER_S * MOTORS_LINE_SLICES_PER_S
+        >> LINE_RAMP_FRACTION_BITS);
+    if (jerk > 0 && jerk_steps == 0)
+        jerk_steps = 1;
+
+    // Continue with the exit speed of the previous move (or start from standstill)
+    if (is_running)
+        entry_steps = line_exit_speed * line_steps_per_mm + line_exit_speed * steps_per_mm_remainder / distance;
+    else {
+        line_carry_x = 0;
+        line_carry_y = 0;
+    }
+    velocity_exit = ((exit_speed * line_steps_per_mm + exit_speed * steps_per_mm_remainder / distance)
+        << LINE_RAMP_FRACTION_BITS) / MOTORS_LINE_SLICES_PER_S;
+    line_ramp_start(&line_ramp, (entry_steps << LINE_RAMP_FRACTION_BITS) / MOTORS_LINE_SLICES_PER_S, velocity_max,
+        velocity_exit, acceleration_slice, jerk_steps);
+    line_exit_speed = exit_speed;
+
+    line_fraction = 0;
+    line_done = 0;
+    line_end = line_steps_lead;
+    line_error = line_steps_lead / 2;
+    is_line_active = true;
+
+    // Fill queues and start both motors at once (queues of a continued move are already running)
+    motors_update();
+    if (!is_running && move_state != MOVE_STATE_REJECTED) {
+        noInterrupts();
+        int8_t result_x = stepper_x->addQueueEntry(NULL, true);
+        int8_t result_y = stepper_y->addQueueEntry(NULL, true);
+        interrupts();
+
+        // One motor can't run without the other one
+        if (result_x != AQE_OK || result_y != AQE_OK) {
+            stepper_x->forceStop();
+            stepper_y->forceStop();
+            motors_line_reject();
         }
+    }
+}
+
+/**
+ * @brief Adds next slices of the coordinated move to the motor queues (call from the loop)
+ * 
+ */
+void motors_update(void) {
+    while (is_line_active && !line_lead->isQueueFull() && !line_follower->isQueueFull())
+        motors_line_slice();
+}
+
+/**
+ * @brief Calculates next slice of the coordinated move and queues steps of both axes
+ * 
+ */
+void motors_line_slice(void) {
+    uint8_t steps_lead, steps_follower = 0;
+    uint32_t exit_speed;
+    uint16_t ticks = MOTORS_LINE_SLICE_TICKS;
+
+    // Whole steps of the lead axis in this slice (average velocity of the slice)
+    line_fraction += line_ramp_next(&line_ramp, line_end - line_done);
+    steps_lead = line_fraction >> LINE_RAMP_FRACTION_BITS;
+    line_fraction &= ((uint32_t)1 << LINE_RAMP_FRACTION_BITS) - 1;
+
+    // Last slice is shorter, so a move that ends with speed doesn't slow down at its end point
+    if (steps_lead > line_end - line_done) {
+        ticks = (uint32_t)MOTORS_LINE_SLICE_TICKS * (line_end - line_done) / steps_lead;
+        steps_lead = line_end - line_done;
+    }
+    line_done += steps_lead;
+
+    // Follower steps (Bresenham)
+    for (uint8_t step = 0; step < steps_lead; step++) {
+        line_error -= line_steps_follower;
+        if (line_error < 0) {
+            line_error += line_steps_lead;
+            steps_follower++;
+        }
+    }
+
+    // Follower gets a pause if it doesn't move, so both queues always hold the same time.
+    // Refused slice would lose its steps, so the rest of the line is dropped
+    if (!motors_line_queue(line_lead, steps_lead, is_line_lead_count_up, ticks, line_carry_lead)
+        || !motors_line_queue(line_follower, steps_follower, is_line_follower_count_up, ticks, line_carry_follower)) {
+        motors_line_reject();
+        return;
+    }
+
+    // All slices are queued
+    if (line_done >= line_end) {
+        is_line_active = false;
+
+        // The exit speed may not be reached on a short move, the next move continues with the real one
+        exit_speed = (line_ramp.velocity >> 8) * MOTORS_LINE_SLICES_PER_S / 256;
+        if (line_steps_per_mm > 0)
+            exit_speed /= line_steps_per_mm;
+        if (exit_speed < line_exit_speed)
+            line_exit_speed = exit_speed;
+    }
+}
+
+/**
+ * @brief Decelerates the coordinated move to standstill as soon as possible
+ * The motors never pass the end point of the queued move. A move that ends with speed and is already completely
+ * queued has to be followed by the next planned move first, it's long enough to stop in (see gcode_pause())
+ * 
+ */
+void motors_line_brake(void) {
+    uint32_t steps;
+
+    // Nothing is being queued
+    if (!is_line_active) {
+        line_exit_speed = 0;
+        return;
+    }
+
+    steps = line_ramp_brake_steps(&line_ramp, 0) + (line_ramp.velocity >> LINE_RAMP_FRACTION_BITS);
+    if (line_done + steps < line_end)
+        line_end = line_done + steps;
+    line_ramp.velocity_exit = 0;
+    line_exit_speed = 0;
+}
+
+/**
+ * @brief Queues steps of one slice for the motor (evenly spaced)
+ * Ticks left after the integer division are carried to the next slice, so both motors keep the same time
+ * 
+ * @param stepper - motor
+ * @param steps - steps in the slice (0 - pause)
+ * @param count_up - direction
+ * @param ticks - length of the slice
+ * @param carry - ticks carried from the previous slice
+ * @return boolean - false if the queue refused the entry
+ */
+boolean motors_line_queue(FastAccelStepper *stepper, uint8_t steps, boolean count_up, uint16_t ticks,
+    uint16_t *carry) {
+    struct stepper_command_s command;
+
+    ticks += *carry;
+    command.steps = steps;
+    command.count_up = count_up;
+    if (steps == 0) {
+        // Pause that is too short for the queue is added to the next slice
+        if (ticks < MIN_CMD_TICKS) {
+            *carry = ticks;
+            return true;
+        }
+        command.ticks = ticks;
+        *carry = 0;
+    }
+    else {
+        command.ticks = ticks / steps;
+        *carry = ticks - command.ticks * steps;
+    }
+    return stepper->addQueueEntry(&command, false) == AQE_OK;
+}
+
+/**
+ * @brief Stops queuing the coordinated move after the motors refused its steps
+ * Queued steps run out, the job is paused by the rejected move (positions come from the motors, so nothing drifts)
+ * 
+ */
+void motors_line_reject(void) {
+    is_line_active = false;
+    line_exit_speed = 0;
+    move_state = MOVE_STATE_REJECTED;
 }
 
 /**
@@ -184,6 +531,11 @@ void motors_disable(void) {
  * @return boolean - true if motors are stopped
  */
 boolean is_motors_stopped() {
+#ifdef COORDINATED_MOVES
+    if (is_line_active)
+        return false;
+#endif
+
     /*boolean stepper_x_decelerating_or_stopped = !stepper_x->isRunning()
         || stepper_x->rampState() == RAMP_STATE_DECELERATE
         || stepper_x->rampState() == RAMP_STATE_DECELERATE_TO_STOP
@@ -199,11 +551,30 @@ boolean is_motors_stopped() {
     return !stepper_x->isRunning() && !stepper_y->isRunning();
 }
 
+/**
+ * @brief Checks if all steps of the coordinated move are queued (a move that ends with speed can be followed)
+ * 
+ * @return boolean - true if the next move can be started
+ */
+boolean is_motors_move_queued() {
+    return !is_line_active;
+}
+
 /**
  * @brief Stops motors with deceleration
  * 
  */
 void motors_stop(void) {
+    // Move that hasn't started yet ends when the motors are stopped
+    if (move_state == MOVE_STATE_QUEUED)
+        move_state = MOVE_STATE_RUNNING;
+
+    // Coordinated move decelerates along the line
+    if (is_line_active || line_exit_speed > 0) {
+        motors_line_brake();
+        return;
+    }
+
     stepper_x->stopMove();
     stepper_y->stopMove();
 }
@@ -214,6 +585,9 @@ void motors_stop(void) {
  */
 void motors_abort_and_reset(void) {
     // Stop motors without deceleration
+    is_line_active = false;
+    line_exit_speed = 0;
+    move_state = MOVE_STATE_DONE;
     stepper_x->forceStop();
     stepper_y->forceStop();
 
@@ -246,7 +620,38 @@ void motors_disable_z(void) {
  * 
  */
 void motors_start_z(void) {
+#ifdef DC_MAIN_MOTOR
+    speed_controller_start(false);
+#else
     stepper_z->moveByAcceleration(stepper_z->getAcceleration());
+#endif
+}
+
+/**
+ * @brief Starts z motor for one stitch (it is stopped after the next needle interrupt)
+ * The DC main motor slows down before the needle-up position and stops at the interrupt by itself
+ * 
+ */
+void motors_start_z_stitch(void) {
+    // Starts from standstill (the stop may have started before the last pulse)
+    needle_sensor_restart();
+
+#ifdef DC_MAIN_MOTOR
+    speed_controller_start(true);
+#else
+    motors_start_z();
+#endif
+}
+
+/**
+ * @brief Starts moving Z motor to absolute position (with current speed and acceleration)
+ * 
+ * @param position - Z position in steps
+ */
+void motors_move_z_to(int32_t position) {
+    // Needle stops at the position before the next stitch
+    needle_sensor_restart();
+    stepper_z->moveTo(position);
 }
 
 /**
@@ -254,7 +659,38 @@ void motors_start_z(void) {
  * 
  */
 void motors_stop_z(void) {
+    // Period to the next pulse isn't a revolution
+    needle_sensor_restart();
+
+#ifdef DC_MAIN_MOTOR
+    speed_controller_stop();
+#else
     stepper_z->stopMove();
+#endif
+}
+
+/**
+ * @brief Gets current Z motor position
+ * 
+ * @return int32_t - motor position in steps
+ */
+int32_t motors_get_z_steps() {
+    return stepper_z->getCurrentPosition();
+}
+
+/**
+ * @brief Gets Z motor position at the time in the recent past (steps made since then at the current speed are
+ * taken back)
+ * 
+ * @param time - micros
+ * @return int32_t - motor position in steps
+ */
+int32_t motors_get_z_steps_at(uint32_t time) {
+    int32_t position = stepper_z->getCurrentPosition();
+    uint32_t elapsed = micros() - time;
+
+    // mHz * us
+    return position - (int64_t)stepper_z->getCurrentSpeedInMilliHz() * elapsed / 1000000000;
 }
 
 /**
@@ -263,5 +699,9 @@ void motors_stop_z(void) {
  * @return boolean - true if motor is stopped
  */
 boolean is_motor_z_stopped() {
+#ifdef DC_MAIN_MOTOR
+    return is_speed_controller_stopped();
+#else
     return !stepper_z->isRunning();
+#endif
 }
@@ -36,14 +36,92 @@ void needle_sensor_setup(void) {
 }
 
 /**
- * @brief Sets needle_interrupt_flag flag
+ * @brief Timestamps needle pulse, updates periods and sets needle_interrupt_flag flag
  * 
  */
 void needle_sensor_callback(void) {
+    uint32_t time = micros();
+    uint32_t period = time - needle_pulse_time;
+    uint32_t period_average;
+    uint8_t missed;
+
+    // Double-fired edge (sensor bounce)
+    if (needle_pulse_count > 0 && period < NEEDLE_SENSOR_MIN_PERIOD_US) {
+        needle_double_count++;
+        return;
+    }
+
+    needle_pulse_time = time;
+    needle_pulse_count++;
     needle_interrupt_flag = true;
-#ifdef DEBUG
-    serial->println("Needle interrupt");
-#endif
+
+    // First pulse after the stop has no period (the needle stopped between stitches or didn't turn for a long time)
+    if (needle_pulse_count == 1 || is_needle_restarted || period >= NEEDLE_SENSOR_TIMEOUT_US) {
+        needle_periods_count = 0;
+        needle_periods_sum = 0;
+        is_needle_restarted = false;
+    }
+
+    else {
+        // Missed pulses (period is about a multiple of the average one)
+        if (needle_periods_count == NEEDLE_SENSOR_PERIODS) {
+            period_average = needle_periods_sum / NEEDLE_SENSOR_PERIODS;
+            if (period > period_average + period_average / 2) {
+                missed = (period + period_average / 2) / period_average - 1;
+                needle_missed_count += missed;
+                period /= missed + 1;
+            }
+
+            // Replace the oldest period
+            needle_periods_sum -= needle_periods[needle_periods_head];
+        }
+        else
+            needle_periods_count++;
+
+        needle_periods[needle_periods_head] = period;
+        needle_periods_sum += period;
+        needle_periods_head = (needle_periods_head + 1) & (NEEDLE_SENSOR_PERIODS - 1);
+    }
+
+    // Z motor position of the pulse is read outside of the interrupt (see needle_sensor_update())
+    is_needle_position_pending = true;
+}
+
+/**
+ * @brief Finds Z motor position of the last pulse (needle index), call often (motion task)
+ * Z position can't be read in the interrupt, because the stepper library enables interrupts while reading it.
+ * The steps made since the pulse are taken back by the current speed
+ * 
+ */
+void needle_sensor_update(void) {
+    uint32_t time, count;
+    int32_t position;
+
+    if (!is_needle_position_pending)
+        return;
+
+    noInterrupts();
+    time = needle_pulse_time;
+    count = needle_pulse_count;
+    is_needle_position_pending = false;
+    interrupts();
+
+    position = motors_get_z_steps_at(time);
+
+    noInterrupts();
+    if (count > 1)
+        needle_index_steps = position - needle_pulse_position_z;
+    needle_pulse_position_z = position;
+    interrupts();
+}
+
+/**
+ * @brief Marks that the needle stops before the next pulse (stop between stitches)
+ * The next period isn't a revolution at the running speed, so the periods start again from it
+ * 
+ */
+void needle_sensor_restart(void) {
+    is_needle_restarted = true;
 }
 
 /**
@@ -55,6 +133,160 @@ boolean needle_sensor_get_interrupt_flag() {
     return needle_interrupt_flag;
 }
 
+/**
+ * @brief Returns filtered needle period (average of the last NEEDLE_SENSOR_PERIODS pulses)
+ * 
+ * @return uint32_t - period in us (0 if the needle is stopped or there are no periods yet)
+ */
+uint32_t needle_sensor_get_period() {
+    uint32_t time, sum;
+    uint8_t count;
+
+    noInterrupts();
+    time = needle_pulse_time;
+    sum = needle_periods_sum;
+    count = needle_periods_count;
+    interrupts();
+
+    // No pulses for a long time
+    if (count == 0 || micros() - time >= NEEDLE_SENSOR_TIMEOUT_US)
+        return 0;
+    return sum / count;
+}
+
+/**
+ * @brief Returns filtered needle speed
+ * 
+ * @return uint16_t - revolutions (stitches) per minute, 0 if stopped or unknown
+ */
+uint16_t needle_sensor_get_rpm() {
+    uint32_t period = needle_sensor_get_period();
+    return period > 0 ? 60000000UL / period : 0;
+}
+
+/**
+ * @brief Returns pulse counter and the period of the last revolution (for the DC main motor control)
+ * 
+ * @param period - us (0 if it is the first pulse after the stop)
+ * @return uint32_t - pulses since the start
+ */
+uint32_t needle_sensor_get_pulse(uint32_t *period) {
+    uint32_t count;
+
+    noInterrupts();
+    count = needle_pulse_count;
+    *period = needle_periods_count > 0
+              ? needle_periods[(needle_periods_head - 1) & (NEEDLE_SENSOR_PERIODS - 1)] : 0;
+    interrupts();
+    return count;
+}
+
+/**
+ * @brief Returns Z motor steps made since the last needle pulse
+ * 
+ * @return int32_t - steps
+ */
+int32_t needle_sensor_get_steps_since_index() {
+    int32_t position;
+
+    needle_sensor_update();
+    noInterrupts();
+    position = needle_pulse_position_z;
+    interrupts();
+
+    return motors_get_z_steps() - position;
+}
+
+/**
+ * @brief Returns Z motor position at the last needle pulse
+ * 
+ * @param position - Z position in steps
+ * @return boolean - false if there were no pulses yet
+ */
+boolean needle_sensor_get_index_position(int32_t *position) {
+    boolean is_known;
+
+    needle_sensor_update();
+    noInterrupts();
+    *position = needle_pulse_position_z;
+    is_known = needle_pulse_count > 0;
+    interrupts();
+    return is_known;
+}
+
+/**
+ * @brief Returns Z motor steps between the last two pulses (to calibrate STEPS_PER_REVOLUTION_Z)
+ * 
+ * @return int32_t - steps per revolution (0 if unknown)
+ */
+int32_t needle_sensor_get_steps_per_revolution() {
+    int32_t steps;
+
+    needle_sensor_update();
+    noInterrupts();
+    steps = needle_index_steps;
+    interrupts();
+    return steps;
+}
+
+/**
+ * @brief Predicts time until the next needle pulse (needle-up)
+ * The rest of the revolution is taken from Z motor steps since the last pulse, or from the time if Z didn't move
+ * 
+ * @return int32_t - us (0 if the pulse is overdue, -1 if the needle is stopped or the speed is unknown)
+ */
+int32_t needle_sensor_get_time_to_needle_up() {
+    uint32_t period = needle_sensor_get_period();
+    uint32_t elapsed;
+    int32_t steps;
+
+    if (period == 0)
+        return -1;
+
+    // Part of the revolution by motor steps
+    steps = needle_sensor_get_steps_since_index();
+    if (steps > 0) {
+        if (steps >= STEPS_PER_REVOLUTION_Z)
+            return 0;
+        return period / STEPS_PER_REVOLUTION_Z * (STEPS_PER_REVOLUTION_Z - steps);
+    }
+
+    // Part of the revolution by time
+    noInterrupts();
+    elapsed = micros() - needle_pulse_time;
+    interrupts();
+    return elapsed >= period ? 0 : period - elapsed;
+}
+
+/**
+ * @brief Returns number of missed pulses (periods that are a multiple of the average one while the needle keeps
+ * running, periods across stops between stitches are not checked)
+ * 
+ * @return uint16_t - missed pulses since the start
+ */
+uint16_t needle_sensor_get_missed_count() {
+    uint16_t count;
+
+    noInterrupts();
+    count = needle_missed_count;
+    interrupts();
+    return count;
+}
+
+/**
+ * @brief Returns number of ignored double-fired edges
+ * 
+ * @return uint16_t - double edges since the start
+ */
+uint16_t needle_sensor_get_double_count() {
+    uint16_t count;
+
+    noInterrupts();
+    count = needle_double_count;
+    interrupts();
+    return count;
+}
+
 /**
  * @brief Clears needle interrupt flag
  * 
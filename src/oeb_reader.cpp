@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "config.hpp"
+#include "datatypes.hpp"
+#include "oeb_reader.hpp"
+
+/**
+ * @brief Reads and checks header of the selected .OEB file and resets reader
+ * Attention! The file must be rewound before
+ * 
+ * @return boolean - true if the header is valid
+ */
+boolean oeb_reader_begin() {
+    if (!oeb_reader_read_header())
+        return false;
+
+    // Reset records buffer
+    oeb_records_index = 0;
+    oeb_records_count = 0;
+    oeb_record_number = 0;
+
+    // Reset position and settings
+    oeb_x = 0;
+    oeb_y = 0;
+    oeb_jump_speed = SPEED_INITIAL_XY_MM_S;
+    oeb_stitch_speed = SPEED_INITIAL_XY_MM_S;
+    oeb_acceleration_x = ACCELERATION_INITIAL_X_MM_S;
+    oeb_acceleration_y = ACCELERATION_INITIAL_Y_MM_S;
+    oeb_acceleration_z = ACCELERATION_INITIAL_Z_HZ;
+    oeb_is_tensioned = false;
+    oeb_progress = 0;
+    oeb_is_finished = false;
+
+    // Enable steppers (M17)
+    gcode_queue_command(COMMAND_ENABLE, 0, 0, 0, 0);
+    return true;
+}
+
+/**
+ * @brief Reads design information from the header of the selected .OEB file
+ * Attention! The file must be rewound before
+ * 
+ * @param metadata - stitch count, color count and bounding box
+ * @return boolean - true if the header is valid
+ */
+boolean oeb_reader_read_metadata(file_metadata_t *metadata) {
+    if (!oeb_reader_read_header())
+        return false;
+
+    metadata->stitch_count = oeb_header.stitch_count;
+    metadata->color_count = oeb_header.color_count;
+
+    // Not stored in the header
+    metadata->jump_count = 0;
+    metadata->duration = 0;
+
+    // Steps -> 0.1 mm
+    metadata->x_min = (int32_t)oeb_header.x_min * 10 / STEPS_PER_MM_X;
+    metadata->y_min = (int32_t)oeb_header.y_min * 10 / STEPS_PER_MM_Y;
+    metadata->x_max = (int32_t)oeb_header.x_max * 10 / STEPS_PER_MM_X;
+    metadata->y_max = (int32_t)oeb_header.y_max * 10 / STEPS_PER_MM_Y;
+    return true;
+}
+
+/**
+ * @brief Reads and checks header of the file
+ * 
+ * @return boolean - true if the header is valid
+ */
+boolean oeb_reader_read_header() {
+    return sd_card_read_data(&oeb_header, sizeof(oeb_header)) == sizeof(oeb_header)
+        && memcmp(oeb_header.magic, OEB_MAGIC, OEB_MAGIC_LENGTH) == 0
+        && oeb_header.header_size == sizeof(oeb_header_t)
+        && oeb_header.record_size == sizeof(oeb_record_t)
+        && oeb_header.steps_per_mm_x == STEPS_PER_MM_X
+        && oeb_header.steps_per_mm_y == STEPS_PER_MM_Y;
+}
+
+/**
+ * @brief Converts next record into commands if there is enough space in the queue
+ * 
+ * @return boolean - false if the end of file is reached and all commands are queued
+ */
+boolean oeb_reader_read_ahead() {
+    oeb_record_t *record;
+
+    // End of file
+    if (oeb_is_finished)
+        return false;
+
+    // Wait for space in the queue
+    if (command_queue_get_free() < OEB_MAX_COMMANDS_PER_RECORD)
+        return true;
+
+    // No more records -> stop and disable motors (M5, M18)
+    record = oeb_record_number < oeb_header.record_count ? oeb_reader_next_record() : NULL;
+    if (!record) {
+        gcode_queue_command(COMMAND_STOP_Z, 0, 0, 0, 0);
+        gcode_queue_command(COMMAND_DISABLE, 0, 0, 0, 0);
+        oeb_is_finished = true;
+        return true;
+    }
+
+    if (record->flags & OEB_FLAG_CONTROL)
+        oeb_reader_queue_control(record);
+    else
+        oeb_reader_queue_record(record);
+
+    // Update progress
+    oeb_record_number++;
+    if (oeb_record_number * 100 / oeb_header.record_count != oeb_progress) {
+        oeb_progress = oeb_record_number * 100 / oeb_header.record_count;
+        gcode_queue_command(COMMAND_PROGRESS, 0, 0, 0, oeb_progress);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Returns next record (reads next chunk of records from the file if needed)
+ * 
+ * @return oeb_record_t* - next record or NULL in case of end of file
+ */
+oeb_record_t *oeb_reader_next_record() {
+    int16_t bytes_read;
+
+    // Read next chunk
+    if (oeb_records_index >= oeb_records_count) {
+        bytes_read = sd_card_read_data(oeb_records, sizeof(oeb_records));
+        if (bytes_read < (int16_t)sizeof(oeb_record_t))
+            return NULL;
+        oeb_records_count = bytes_read / sizeof(oeb_record_t);
+        oeb_records_index = 0;
+    }
+
+    return &oeb_records[oeb_records_index++];
+}
+
+/**
+ * @brief Converts move record into commands
+ * 
+ * @param record - move record
+ */
+void oeb_reader_queue_record(oeb_record_t *record) {
+    // Stop main motor (M5)
+    if (record->flags & OEB_FLAG_TRIM)
+        gcode_queue_command(COMMAND_STOP_Z, 0, 0, 0, 0);
+
+    // Pause (M0)
+    if (record->flags & OEB_FLAG_PAUSE)
+        gcode_queue_command(COMMAND_PAUSE, 0, 0, 0, record->code);
+
+    // Change tension (M41 / M42) and wait for the servo
+    if (((record->flags & OEB_FLAG_TENSION) != 0) != oeb_is_tensioned) {
+        oeb_is_tensioned = !oeb_is_tensioned;
+        gcode_queue_command(COMMAND_TENSION, 0, 0, 0, oeb_is_tensioned);
+        if (oeb_header.tension_dwell > 0)
+            gcode_queue_command(COMMAND_DWELL, 0, 0, 0, oeb_header.tension_dwell);
+    }
+
+    // Move (G0 / G1)
+    if (record->dx != 0 || record->dy != 0) {
+        oeb_x += record->dx;
+        oeb_y += record->dy;
+        gcode_queue_command(COMMAND_MOVE, 0,
+            motors_steps_to_fixed(oeb_x, STEPS_PER_MM_X), motors_steps_to_fixed(oeb_y, STEPS_PER_MM_Y),
+            (record->flags & OEB_FLAG_JUMP) ? oeb_jump_speed : oeb_stitch_speed);
+    }
+
+    // Stitch (M3 S.. I1)
+    if (record->flags & OEB_FLAG_STITCH)
+        gcode_queue_command(COMMAND_START_Z, COMMAND_FLAG_UNTIL_INTERRUPT, 0, 0, record->value);
+}
+
+/**
+ * @brief Applies control record
+ * 
+ * @param record - control record
+ */
+void oeb_reader_queue_control(oeb_record_t *record) {
+    uint32_t argument = (uint16_t)record->dx | ((uint32_t)(uint16_t)record->dy << 16);
+
+    switch (record->code)
+    {
+    case OEB_CONTROL_JUMP_SPEED:
+        oeb_jump_speed = argument;
+        break;
+
+    case OEB_CONTROL_STITCH_SPEED:
+        oeb_stitch_speed = argument;
+        break;
+
+    case OEB_CONTROL_ACCELERATION_X:
+    case OEB_CONTROL_ACCELERATION_Y:
+    case OEB_CONTROL_ACCELERATION_Z:
+        if (record->code == OEB_CONTROL_ACCELERATION_X)
+            oeb_acceleration_x = argument;
+        else if (record->code == OEB_CONTROL_ACCELERATION_Y)
+            oeb_acceleration_y = argument;
+        else
+            oeb_acceleration_z = argument;
+
+        // M201
+        gcode_queue_command(COMMAND_ACCELERATION, 0, oeb_acceleration_x, oeb_acceleration_y, oeb_acceleration_z);
+        break;
+
+    case OEB_CONTROL_DWELL:
+        // G4
+        gcode_queue_command(COMMAND_DWELL, 0, 0, 0, argument);
+        break;
+    
+    default:
+        break;
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "config.hpp"
+#include "datatypes.hpp"
+#include "scheduler.hpp"
+
+/**
+ * @brief Sets function and period of the task and resets its statistics
+ * 
+ * @param task - TASK_...
+ * @param run - task function (returns true if lower priority tasks should wait for the next tick)
+ * @param period - time between runs (ms, 0 - every tick)
+ */
+void scheduler_set_task(uint8_t task, boolean (*run)(void), uint16_t period) {
+    scheduler_tasks[task].run = run;
+    scheduler_tasks[task].period = period;
+    scheduler_tasks[task].last_run = millis();
+    scheduler_tasks[task].wcet = 0;
+    scheduler_tasks[task].skipped_count = 0;
+}
+
+/**
+ * @brief Runs one tick of loop(): all due tasks in priority order
+ * With the budget, a lower priority task is held back if a higher one asked to wait (motion executed a command and
+ * the next one may be ready) or if its worst-case execution time doesn't fit into the rest of SCHEDULER_TICK_BUDGET_US,
+ * but not longer than SCHEDULER_MAX_DELAY_MS since its last run. The first task is never held back
+ * 
+ * @param is_budgeted - hold back tasks by the budget (false - run all due tasks)
+ */
+void scheduler_tick(boolean is_budgeted) {
+    unsigned long tick_start = micros(), start, time;
+    boolean is_waiting = false;
+    scheduler_task_t *task;
+
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        task = &scheduler_tasks[i];
+        if (!task->run || (task->period > 0 && millis() - task->last_run < task->period))
+            continue;
+
+        start = micros();
+        if (is_budgeted && i > 0 && millis() - task->last_run < SCHEDULER_MAX_DELAY_MS
+            && (is_waiting || start - tick_start + task->wcet > SCHEDULER_TICK_BUDGET_US)) {
+            task->skipped_count++;
+            continue;
+        }
+
+        task->last_run = millis();
+        is_scheduler_reset = false;
+        if (task->run())
+            is_waiting = true;
+        time = micros() - start;
+
+        if (!is_scheduler_reset && time > task->wcet)
+            task->wcet = time;
+    }
+}
+
+/**
+ * @brief Clears worst-case execution times and skipped runs of all tasks (e.g. at the start of the job, so the
+ * drawing of menus before it doesn't hold back the UI during the job)
+ * 
+ */
+void scheduler_reset_statistics(void) {
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+        scheduler_tasks[i].wcet = 0;
+        scheduler_tasks[i].skipped_count = 0;
+    }
+    is_scheduler_reset = true;
+}
+
+/**
+ * @brief Returns measured worst-case execution time of the task
+ * 
+ * @param task - TASK_...
+ * @return uint32_t - us
+ */
+uint32_t scheduler_get_wcet(uint8_t task) {
+    return scheduler_tasks[task].wcet;
+}
+
+/**
+ * @brief Returns number of runs of the task held back by the tick budget
+ * 
+ * @param task - TASK_...
+ * @return uint32_t - skipped runs
+ */
+uint32_t scheduler_get_skipped_count(uint8_t task) {
+    return scheduler_tasks[task].skipped_count;
+}
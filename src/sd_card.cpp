@@ -37,24 +37,68 @@ boolean sd_card_setup() {
 }
 
 /**
- * @brief Counts number of files in root directory
+ * @brief Builds sorted index of files in root directory (newest first)
+ * Loads it from the index file if files were not changed, otherwise scans the directory and writes the index file
+ * Only the newest SD_INDEX_MAX_FILES files are kept
  * 
  */
-void sd_card_count_files(void) {
+void sd_card_build_index(void) {
+    uint16_t position, dir_index, root_entry_count;
+    uint32_t date_time, root_checksum;
+    boolean is_signature_valid;
+
     // Reset number of files
     number_of_files = 0;
+    index_cursor = -1;
 
-    // Open root directory
+    // Open root directory (stays open, files are opened by their index in it)
+    dir.close();
     dir.open("/");
 
-    // List all files
+    // Files were not changed -> skip the scan
+    is_signature_valid = sd_card_root_signature(&root_entry_count, &root_checksum);
+    if (is_signature_valid && sd_card_index_load(root_entry_count, root_checksum)) {
+#ifdef DEBUG
+        serial->print("Loaded index: ");
+        serial->print(number_of_files);
+        serial->println(" files");
+#endif
+        return;
+    }
+
+    // List all files (looking for the index file moved directory position)
+    dir.rewind();
     while (file.openNext(&dir, O_RDONLY)) {
-        // Increment counter if it's file and name is valid
-        if (!file.isDir() && file.getName(file_name_temp, sizeof(file_name_temp)) && is_gcode())
-            number_of_files++;
+        if (!file.isDir() && file.getName(file_name_temp, sizeof(file_name_temp)) && is_gcode()) {
+            // Packed FAT date and time can be compared as a number
+            file.getModifyDateTime(&pdate, &ptime);
+            date_time = (uint32_t)pdate << 16 | ptime;
+            dir_index = file.dirIndex();
+
+            // Find position after all newer files (insertion sort)
+            position = number_of_files;
+            while (position > 0 && index_date_times[position - 1] < date_time)
+                position--;
+
+            // Insert file (the oldest one is dropped if index is full)
+            if (position < SD_INDEX_MAX_FILES) {
+                if (number_of_files < SD_INDEX_MAX_FILES)
+                    number_of_files++;
+                memmove(&index_date_times[position + 1], &index_date_times[position],
+                    (number_of_files - 1 - position) * sizeof(index_date_times[0]));
+                memmove(&index_dir_indexes[position + 1], &index_dir_indexes[position],
+                    (number_of_files - 1 - position) * sizeof(index_dir_indexes[0]));
+                index_date_times[position] = date_time;
+                index_dir_indexes[position] = dir_index;
+            }
+        }
         file.close();
     }
 
+    // Store index for the next boot
+    if (is_signature_valid)
+        sd_card_index_save(root_entry_count, root_checksum);
+
 #ifdef DEBUG
     serial->print("Counted: ");
     serial->print(number_of_files);
@@ -63,120 +107,278 @@ void sd_card_count_files(void) {
 }
 
 /**
- * @brief Gets counted number of files
+ * @brief Counts entries of root directory and calculates checksum of their names, sizes and modify times
+ * Reads raw FAT directory entries, so it's much faster than opening each file
  * 
- * @return uint32_t - number_of_files
+ * @param entry_count - number of files and directories (without the index file)
+ * @param checksum - checksum of the entries
+ * @return boolean - false if the file system is not FAT
  */
-uint32_t sd_card_get_number_of_files() {
-    return number_of_files;
+boolean sd_card_root_signature(uint16_t *entry_count, uint32_t *checksum) {
+    uint8_t entry[SD_DIR_ENTRY_SIZE];
+
+    *entry_count = 0;
+    *checksum = 0;
+
+    // exFAT has different directory entries
+    if (sd.fatType() == FAT_TYPE_EXFAT)
+        return false;
+
+    dir.rewind();
+    while (dir.read(entry, sizeof(entry)) == sizeof(entry)) {
+        // End of directory
+        if (entry[0] == 0)
+            break;
+
+        // Skip deleted entries, long names (volume label attribute is set for them), volume label and the index file
+        if (entry[0] == SD_DIR_ENTRY_DELETED || (entry[11] & SD_DIR_ATTRIBUTE_VOLUME_ID)
+            || memcmp(entry, SD_INDEX_FILE_SHORT_NAME, 11) == 0)
+            continue;
+
+        // Short name, modify time and date, size
+        (*entry_count)++;
+        *checksum = sd_card_checksum(*checksum, entry, 11);
+        *checksum = sd_card_checksum(*checksum, &entry[22], 4);
+        *checksum = sd_card_checksum(*checksum, &entry[28], 4);
+    }
+    dir.rewind();
+
+    return true;
 }
 
 /**
- * @brief Tries to get the next file from the memory card
+ * @brief Adds bytes to the rotating checksum (order of the bytes matters)
  * 
- * @return boolean - true if successful
+ * @param checksum - previous value
+ * @param data - bytes
+ * @param size - number of bytes
+ * @return uint32_t - new value
  */
-boolean sd_card_read_next_file() {
-    // Reset temp maximum value
-    file_time_max_temp = 0;
-
-    // Reset filename valid flag
-    file_name_valid = false;
+uint32_t sd_card_checksum(uint32_t checksum, const uint8_t *data, uint8_t size) {
+    while (size--)
+        checksum = ((checksum << 5) | (checksum >> 27)) ^ *data++;
+    return checksum;
+}
 
-    // Set starting point at first run
-    if (file_time_prev == 0)
-        file_time_prev = UINT32_MAX;
+/**
+ * @brief Loads file index from the index file
+ * 
+ * @param root_entry_count - current number of entries in root directory
+ * @param root_checksum - current checksum of root directory
+ * @return boolean - true if the index file is valid for the current root directory
+ */
+boolean sd_card_index_load(uint16_t root_entry_count, uint32_t root_checksum) {
+    sd_index_header_t header;
+    sd_index_file_entry_t entry;
+
+    is_index_file_valid = false;
+    if (!index_file.open(&dir, SD_INDEX_FILE_NAME, O_RDONLY))
+        return false;
+
+    // Check header
+    if (index_file.read(&header, sizeof(header)) == sizeof(header)
+        && memcmp(header.magic, SD_INDEX_MAGIC, SD_INDEX_MAGIC_LENGTH) == 0
+        && header.entry_size == sizeof(sd_index_file_entry_t)
+        && header.entry_count <= SD_INDEX_MAX_FILES
+        && header.root_entry_count == root_entry_count
+        && header.root_checksum == root_checksum) {
+        // Read entries in the sorted order
+        while (number_of_files < header.entry_count && index_file.read(&entry, sizeof(entry)) == sizeof(entry)) {
+            index_dir_indexes[number_of_files] = entry.dir_index;
+            number_of_files++;
+        }
+        is_index_file_valid = number_of_files == header.entry_count;
+    }
+    index_file.close();
 
-    if (number_of_files > 0) {
-        // Open root directory
-        dir.open("/");
+    if (!is_index_file_valid)
+        number_of_files = 0;
+    return is_index_file_valid;
+}
 
-        // List all files
-        while (file.openNext(&dir, O_RDONLY)) {
-            if (!file.isDir()) {
-                // Get file date time
-                file.getModifyDateTime(&pdate, &ptime);
+/**
+ * @brief Writes file index (with names and sizes of files) to the index file
+ * Attention! Modify times are taken from the stream buffer, call only directly after the directory scan
+ * 
+ * @param root_entry_count - current number of entries in root directory
+ * @param root_checksum - current checksum of root directory
+ */
+void sd_card_index_save(uint16_t root_entry_count, uint32_t root_checksum) {
+    sd_index_header_t header;
+    sd_index_file_entry_t entry;
+
+    is_index_file_valid = false;
+    if (!index_file.open(&dir, SD_INDEX_FILE_NAME, O_RDWR | O_CREAT | O_TRUNC))
+        return;
+
+    memcpy(header.magic, SD_INDEX_MAGIC, SD_INDEX_MAGIC_LENGTH);
+    header.entry_size = sizeof(sd_index_file_entry_t);
+    header.entry_count = number_of_files;
+    header.root_entry_count = root_entry_count;
+    header.reserved = 0;
+    header.root_checksum = root_checksum;
+    is_index_file_valid = index_file.write(&header, sizeof(header)) == sizeof(header);
+
+    for (uint16_t i = 0; i < number_of_files && is_index_file_valid; i++) {
+        memset(&entry, 0, sizeof(entry));
+        entry.date_time = index_date_times[i];
+        entry.dir_index = index_dir_indexes[i];
+
+        // Name and size (metadata is added when the file is opened for the first time)
+        if (file.open(&dir, entry.dir_index, O_RDONLY)) {
+            file.getName(file_name_temp, sizeof(file_name_temp));
+            strncpy(entry.name, file_name_temp, sizeof(entry.name) - 1);
+            entry.size = file.fileSize();
+            file.close();
+        }
 
-                // Convert to epoch
-                file_time_current = date_time_to_epoch(FS_HOUR(ptime), FS_MINUTE(ptime), FS_SECOND(ptime), FS_DAY(pdate), FS_MONTH(pdate) - 1, FS_YEAR(pdate));
+        is_index_file_valid = index_file.write(&entry, sizeof(entry)) == sizeof(entry);
+    }
 
-                // Find next newest file and get name of file
-                if (file_time_current > file_time_max_temp && file_time_current < file_time_prev
-                    && file.getName(file_name_temp, sizeof(file_name_temp)) && is_gcode()) {
-                    // Store local maximum
-                    file_time_max_temp = file_time_current;
+    is_index_file_valid = index_file.close() && is_index_file_valid;
 
-                    // Store selected file
-                    selected_file = file;
+    // Don't leave partially written index file
+    if (!is_index_file_valid)
+        sd.remove(SD_INDEX_FILE_NAME);
+}
 
-                    // Copy bytes of file name
-                    memcpy(file_name, file_name_temp, sizeof(file_name));
+/**
+ * @brief Opens index file and reads entry of the selected file (file position stays at the entry)
+ * 
+ * @param oflag - O_RDONLY or O_RDWR
+ * @param entry - entry of the index file
+ * @return boolean - true if successful (the index file must be closed then)
+ */
+boolean sd_card_index_open_entry(oflag_t oflag, sd_index_file_entry_t *entry) {
+    uint32_t position = sizeof(sd_index_header_t) + (uint32_t)index_cursor * sizeof(sd_index_file_entry_t);
 
-                    // Set flag if at least one file exists
-                    file_name_valid = true;
-                }
-            }
-            file.close();
-        }
+    if (!is_index_file_valid || index_cursor < 0 || !index_file.open(&dir, SD_INDEX_FILE_NAME, oflag))
+        return false;
 
-        // Store current max file time for next call
-        file_time_prev = file_time_max_temp;
+    // Check that the entry belongs to the selected file
+    if (!index_file.seekSet(position) || index_file.read(entry, sizeof(*entry)) != sizeof(*entry)
+        || entry->dir_index != index_dir_indexes[index_cursor] || !index_file.seekSet(position)) {
+        index_file.close();
+        return false;
     }
+    return true;
+}
 
-    // Return flag
-    return file_name_valid;
+/**
+ * @brief Gets metadata of the selected file from the index file
+ * 
+ * @param metadata - stitch count, color count and bounding box
+ * @return boolean - true if metadata is known
+ */
+boolean sd_card_get_metadata(file_metadata_t *metadata) {
+    sd_index_file_entry_t entry;
+
+    if (!sd_card_index_open_entry(O_RDONLY, &entry))
+        return false;
+    index_file.close();
+
+    if (!(entry.flags & SD_INDEX_FLAG_METADATA))
+        return false;
+    *metadata = entry.metadata;
+    return true;
 }
 
 /**
- * @brief Tries to get the previous file from the memory card
+ * @brief Stores metadata of the selected file in the index file
  * 
- * @return boolean - true if successful
+ * @param metadata - stitch count, color count and bounding box
  */
-boolean sd_card_read_prev_file() {
-    // Reset temp minimum value
-    file_time_min_temp = UINT32_MAX;
+void sd_card_set_metadata(file_metadata_t *metadata) {
+    sd_index_file_entry_t entry;
 
-    // Reset filename valid flag
-    file_name_valid = false;
+    if (!sd_card_index_open_entry(O_RDWR, &entry))
+        return;
 
-    if (number_of_files > 0) {
-        // Open root directory
-        dir.open("/");
+    entry.metadata = *metadata;
+    entry.flags |= SD_INDEX_FLAG_METADATA;
+    index_file.write(&entry, sizeof(entry));
+    index_file.close();
+}
 
-        // List all files
-        while (file.openNext(&dir, O_RDONLY)) {
-            if (!file.isDir()) {
-                // Get file date time
-                file.getModifyDateTime(&pdate, &ptime);
+/**
+ * @brief Gets needle speed of the selected file settled by the last run (SPEED_GOVERNOR)
+ * 
+ * @return uint8_t - % of the speed from the file (0 if it's not tuned yet)
+ */
+uint8_t sd_card_get_needle_speed() {
+    sd_index_file_entry_t entry;
 
-                // Convert to epoch
-                file_time_current = date_time_to_epoch(FS_HOUR(ptime), FS_MINUTE(ptime), FS_SECOND(ptime), FS_DAY(pdate), FS_MONTH(pdate) - 1, FS_YEAR(pdate));
+    if (!sd_card_index_open_entry(O_RDONLY, &entry))
+        return 0;
+    index_file.close();
+    return entry.needle_speed;
+}
 
-                // Find previous newest file and get name of file
-                if (file_time_current < file_time_min_temp && file_time_current > file_time_prev
-                    && file.getName(file_name_temp, sizeof(file_name_temp)) && is_gcode()) {
-                    // Store local minimum
-                    file_time_min_temp = file_time_current;
+/**
+ * @brief Stores settled needle speed of the selected file in the index file (SPEED_GOVERNOR)
+ * 
+ * @param percent - % of the speed from the file
+ */
+void sd_card_set_needle_speed(uint8_t percent) {
+    sd_index_file_entry_t entry;
 
-                    // Store selected file
-                    selected_file = file;
+    if (!sd_card_index_open_entry(O_RDWR, &entry))
+        return;
 
-                    // Copy bytes of file name
-                    memcpy(file_name, file_name_temp, sizeof(file_name));
+    entry.needle_speed = percent;
+    index_file.write(&entry, sizeof(entry));
+    index_file.close();
+}
 
-                    // Set flag if at least one file exists
-                    file_name_valid = true;
-                }
-            }
-            file.close();
-        }
+/**
+ * @brief Gets counted number of files
+ * 
+ * @return uint32_t - number_of_files
+ */
+uint32_t sd_card_get_number_of_files() {
+    return number_of_files;
+}
 
-        // Store current min file time for next call
-        file_time_prev = file_time_min_temp;
-    }
+/**
+ * @brief Opens file from the index and gets its name and type
+ * 
+ * @param index - position in the index (0 is the newest file)
+ * @return boolean - true if successful
+ */
+boolean sd_card_select_file(uint32_t index) {
+    if (index >= number_of_files)
+        return false;
+
+    // Open file by its index in root directory
+    selected_file.close();
+    if (!selected_file.open(&dir, index_dir_indexes[index], O_RDONLY)
+        || !selected_file.getName(file_name_temp, sizeof(file_name_temp)) || !is_gcode())
+        return false;
+
+    // Store type of file and copy bytes of file name
+    selected_file_type = file_type_temp;
+    memcpy(file_name, file_name_temp, sizeof(file_name));
 
-    // Return flag
-    return file_name_valid;
+    index_cursor = index;
+    return true;
+}
+
+/**
+ * @brief Selects the next (older) file
+ * 
+ * @return boolean - true if successful
+ */
+boolean sd_card_read_next_file() {
+    return sd_card_select_file(index_cursor + 1);
+}
+
+/**
+ * @brief Selects the previous (newer) file
+ * 
+ * @return boolean - true if successful
+ */
+boolean sd_card_read_prev_file() {
+    return index_cursor > 0 && sd_card_select_file(index_cursor - 1);
 }
 
 /**
@@ -189,12 +391,13 @@ char *sd_card_get_file_name() {
 }
 
 /**
- * @brief Closes current file and resets file counter
+ * @brief Closes current file and resets file cursor
  * 
  */
 void sd_card_reset_files(void) {
+    sd_card_stream_stop();
     selected_file.close();
-    file_time_prev = 0;
+    index_cursor = -1;
 }
 
 /**
@@ -202,42 +405,294 @@ void sd_card_reset_files(void) {
  * 
  */
 void sd_card_file_rewind(void) {
-    selected_file.rewind();
+    sd_card_file_seek(0);
+
+    // Reset statistics
+    stream_bytes = 0;
+    stream_time = 0;
 }
 
 /**
- * @brief Checks current file
+ * @brief Checks current file and detects if it can be read by raw sectors
+ * Call at the job start (before sd_card_file_rewind())
  * 
  * @return boolean - true if isOpen() and isReadable()
  */
 boolean sd_card_check_selected_file() {
-    return selected_file.isOpen() && selected_file.isReadable();
+    uint32_t sector_last;
+
+    if (!selected_file.isOpen() || !selected_file.isReadable())
+        return false;
+
+    // Contiguous file is read by multi-sector reads without FAT traversal and cache
+    sd_card_stream_stop();
+    stream_is_contiguous = selected_file.contiguousRange(&stream_sector_first, &sector_last);
+    stream_file_size = selected_file.fileSize();
+
+#ifdef DEBUG
+    serial->println(stream_is_contiguous ? F("Contiguous file") : F("Fragmented file"));
+#endif
+
+    return true;
+}
+
+/**
+ * @brief Returns next line of the selected file without copying it
+ * Line ending is replaced with null-terminator. Lines longer than SD_BLOCK_SIZE can be truncated
+ * 
+ * @param length - length of the line
+ * @return char* - line in the stream buffer (valid until the next call) or NULL at the end of file
+ */
+char *sd_card_read_line(uint16_t *length) {
+    char *line, *end;
+
+    while (true) {
+        // Find end of the line in the buffered data
+        line = &stream_buffer[stream_position];
+        end = (char *)memchr(line, '\n', stream_length - stream_position);
+
+        // Skip rest of the truncated line
+        if (stream_is_skipping_line) {
+            if (end) {
+                stream_position = end - stream_buffer + 1;
+                stream_is_skipping_line = false;
+                continue;
+            }
+            stream_position = stream_length;
+        }
+
+        else if (end)
+            break;
+
+        // Last line without line ending
+        else if (stream_is_end_of_file) {
+            if (stream_position >= stream_length)
+                return NULL;
+            end = &stream_buffer[stream_length];
+            break;
+        }
+
+        // Line doesn't fit into the buffer -> truncate it
+        else if (stream_length - stream_position > SD_BLOCK_SIZE) {
+            end = &line[SD_BLOCK_SIZE];
+            stream_is_skipping_line = true;
+            break;
+        }
+
+        // End of file after skipped line
+        if (stream_is_end_of_file)
+            return NULL;
+
+        sd_card_read_block();
+    }
+
+    // Replace line ending
+    *end = 0;
+    *length = end - line;
+    stream_position += *length + 1;
+
+    // Last line has no line ending
+    if (stream_position > stream_length)
+        stream_position = stream_length;
+    return line;
+}
+
+/**
+ * @brief Moves unread part of the buffer to its beginning and reads the next sector after it
+ * 
+ */
+void sd_card_read_block(void) {
+    uint32_t time = micros();
+    int16_t bytes_read = 0;
+
+    // Keep the beginning of the line
+    stream_length -= stream_position;
+    memmove(stream_buffer, &stream_buffer[stream_position], stream_length);
+    stream_position = 0;
+
+    // Contiguous file -> next sector of the multi-sector read
+    if (stream_is_contiguous)
+        bytes_read = sd_card_read_raw_block(&stream_buffer[stream_length]);
+
+    // Fragmented file (or raw read failed). File position is always sector-aligned,
+    // so SdFat reads directly into the buffer (without cache)
+    if (!stream_is_contiguous)
+        bytes_read = selected_file.read(&stream_buffer[stream_length], SD_BLOCK_SIZE);
+
+    if (bytes_read > 0) {
+        stream_length += bytes_read;
+        stream_bytes += bytes_read;
+        stream_file_position += bytes_read;
+    }
+    else
+        stream_is_end_of_file = true;
+
+    stream_time += micros() - time;
+}
+
+/**
+ * @brief Reads sector at stream_file_position directly from the card
+ * Falls back to the file system (clears stream_is_contiguous) if the card fails
+ * 
+ * @param destination - buffer for the whole sector
+ * @return int16_t - number of file bytes in the sector (0 at the end of file)
+ */
+int16_t sd_card_read_raw_block(char *destination) {
+    // End of file -> release the card
+    if (stream_file_position >= stream_file_size) {
+        sd_card_stream_stop();
+        return 0;
+    }
+
+    // Start multi-sector read
+    if (!stream_is_raw_reading)
+        stream_is_raw_reading = sd.card()->readStart(stream_sector_first + stream_file_position / SD_BLOCK_SIZE);
+
+    // Read next sector
+    if (!stream_is_raw_reading || !sd.card()->readData((uint8_t *)destination)) {
+        sd_card_stream_stop();
+        stream_is_contiguous = false;
+        selected_file.seekSet(stream_file_position);
+
+#ifdef DEBUG
+        serial->println(F("Raw read failed"));
+#endif
+        return 0;
+    }
+
+    // Last sector is not full
+    return stream_file_size - stream_file_position < SD_BLOCK_SIZE ?
+        stream_file_size - stream_file_position : SD_BLOCK_SIZE;
+}
+
+/**
+ * @brief Finishes multi-sector read (the card can't be used for anything else until then)
+ * 
+ */
+void sd_card_stream_stop(void) {
+    if (stream_is_raw_reading) {
+        sd.card()->readStop();
+        stream_is_raw_reading = false;
+    }
+}
+
+/**
+ * @brief Returns speed of the line reader since the file was rewound
+ * 
+ * @return uint32_t - bytes per second of the time spent in reading
+ */
+uint32_t sd_card_get_read_speed() {
+    return stream_time > 0 ? (uint64_t)stream_bytes * 1000000UL / stream_time : 0;
+}
+
+/**
+ * @brief Reads bytes from the current position of the selected file (through the stream buffer)
+ * 
+ * @param data - destination
+ * @param size - number of bytes to read
+ * @return int16_t - number of bytes read
+ */
+int16_t sd_card_read_data(void *data, uint16_t size) {
+    uint16_t bytes_read = 0, chunk;
+
+    while (bytes_read < size) {
+        // Buffer is empty -> read next sector
+        if (stream_position >= stream_length) {
+            if (stream_is_end_of_file)
+                break;
+            sd_card_read_block();
+            continue;
+        }
+
+        // Copy buffered bytes
+        chunk = stream_length - stream_position;
+        if (chunk > size - bytes_read)
+            chunk = size - bytes_read;
+        memcpy((uint8_t *)data + bytes_read, &stream_buffer[stream_position], chunk);
+        stream_position += chunk;
+        bytes_read += chunk;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * @brief Returns size of the selected file
+ * 
+ * @return uint32_t - size in bytes
+ */
+uint32_t sd_card_get_file_size() {
+    return selected_file.fileSize();
+}
+
+/**
+ * @brief Returns position of the stream in the selected file (bytes read from the card)
+ * 
+ * @return uint32_t - offset from the beginning of the file
+ */
+uint32_t sd_card_get_file_position() {
+    return stream_file_position;
+}
+
+/**
+ * @brief Sets current position of the selected file
+ * 
+ * @param position - offset from the beginning of the file
+ * @return boolean - true if successful
+ */
+boolean sd_card_file_seek(uint32_t position) {
+    // Reset stream to the beginning of the sector
+    sd_card_stream_stop();
+    stream_position = 0;
+    stream_length = 0;
+    stream_is_end_of_file = false;
+    stream_is_skipping_line = false;
+    stream_file_position = position - position % SD_BLOCK_SIZE;
+    if (!stream_is_contiguous && !selected_file.seekSet(stream_file_position))
+        return false;
+
+    // Skip bytes before the position
+    if (position % SD_BLOCK_SIZE > 0) {
+        sd_card_read_block();
+        stream_position = position % SD_BLOCK_SIZE;
+        return stream_position <= stream_length;
+    }
+    return true;
 }
 
 /**
- * @brief Reads next line from file to the buffer
+ * @brief Returns type of the selected file
  * 
- * @return boolean - true if the line is read
+ * @return uint8_t - FILE_TYPE_GCODE, FILE_TYPE_OEB or FILE_TYPE_DST
  */
-boolean sd_card_read_next_line() {
-    return selected_file.fgets(buffer, sizeof(buffer)) > 1;
+uint8_t sd_card_get_file_type() {
+    return selected_file_type;
 }
 
 /**
- * @brief Returns current gcode line
+ * @brief Checks if file_name_temp ends with extension
  * 
- * @return char* - gcode line from file
+ * @param extension - extension with dot
+ * @return boolean - true if file_name_temp ends with extension
  */
-char *sd_card_get_buffer() {
-    return buffer;
+boolean file_name_ends_with(const char *extension) {
+    return strlen(file_name_temp) >= strlen(extension)
+            && strcmp(extension, &file_name_temp[strlen(file_name_temp) - strlen(extension)]) == 0;
 }
 
 /**
- * @brief Checks if current file is accepted
+ * @brief Checks if current file is accepted and stores its type in file_type_temp
  * 
- * @return boolean - true is file_name_temp ends with FILE_EXT_UPPER or FILE_EXT_LOWER
+ * @return boolean - true is file_name_temp ends with FILE_EXT_..._UPPER or FILE_EXT_..._LOWER
  */
 boolean is_gcode() {
-    return strcmp(FILE_EXT_UPPER, &file_name_temp[strlen(file_name_temp)-strlen(FILE_EXT_UPPER)]) == 0
-            || strcmp(FILE_EXT_LOWER, &file_name_temp[strlen(file_name_temp)-strlen(FILE_EXT_LOWER)]) == 0;
+    if (file_name_ends_with(FILE_EXT_UPPER) || file_name_ends_with(FILE_EXT_LOWER))
+        file_type_temp = FILE_TYPE_GCODE;
+    else if (file_name_ends_with(FILE_EXT_OEB_UPPER) || file_name_ends_with(FILE_EXT_OEB_LOWER))
+        file_type_temp = FILE_TYPE_OEB;
+    else if (file_name_ends_with(FILE_EXT_DST_UPPER) || file_name_ends_with(FILE_EXT_DST_LOWER))
+        file_type_temp = FILE_TYPE_DST;
+    else
+        file_type_temp = FILE_TYPE_NONE;
+    return file_type_temp != FILE_TYPE_NONE;
 }
@@ -37,14 +37,82 @@ void servo_setup(void) {
 }
 
 /**
- * @brief Sets tension of the thread
+ * @brief Sets tension of the thread (the same pulse is not written again)
  * 
  * @param tension - 0 to 100
+ * @return uint16_t - time until the servo finishes the move (ms, 0 - unchanged)
  */
-void servo_set_tension(uint8_t tension) {
-    // Convert tension to servo pulse
-    servo_pulse = map(tension, 0, 100, SERVO_LOW_TENSION_US, SERVO_HIGH_TENSION_US);
+uint16_t servo_set_tension(uint8_t tension) {
+    uint16_t pulse = servo_get_pulse(tension);
+    uint16_t time;
+
+    if (pulse == servo_pulse)
+        return 0;
 
     // Write pulse to the servo
+    time = servo_get_slew_time(servo_pulse, pulse);
+    servo_pulse = pulse;
     servo.write(servo_pulse);
+    servo_ready_time = millis() + time;
+    return time;
+}
+
+/**
+ * @brief Returns time the servo needs to move from the last written pulse to the tension (slew model)
+ * 
+ * @param tension - 0 to 100
+ * @return uint16_t - ms (0 if the pulse is the same)
+ */
+uint16_t servo_get_move_time(uint8_t tension) {
+    return servo_get_slew_time(servo_pulse, servo_get_pulse(tension));
+}
+
+/**
+ * @brief Returns time the servo needs to move between two tensions (slew model, independent of the servo state)
+ * 
+ * @param tension_from - 0 to 100
+ * @param tension_to - 0 to 100
+ * @return uint16_t - ms (0 if the pulse is the same)
+ */
+uint16_t servo_get_tension_time(uint8_t tension_from, uint8_t tension_to) {
+    return servo_get_slew_time(servo_get_pulse(tension_from), servo_get_pulse(tension_to));
+}
+
+/**
+ * @brief Returns time until the servo finishes the last move
+ * 
+ * @return uint16_t - ms (0 if it's settled)
+ */
+uint16_t servo_get_remaining_time() {
+    unsigned long time = millis();
+    return (long)(servo_ready_time - time) > 0 ? servo_ready_time - time : 0;
+}
+
+/**
+ * @brief Converts tension to the servo pulse
+ * 
+ * @param tension - 0 to 100
+ * @return uint16_t - pulse (us)
+ */
+uint16_t servo_get_pulse(uint8_t tension) {
+    return map(tension, 0, 100, SERVO_LOW_TENSION_US, SERVO_HIGH_TENSION_US);
+}
+
+/**
+ * @brief Calculates time of the servo move by the slew model
+ * 
+ * @param pulse_from - us (0 - unknown position, the whole range is assumed)
+ * @param pulse_to - us
+ * @return uint16_t - ms (0 if the pulses are the same)
+ */
+uint16_t servo_get_slew_time(uint16_t pulse_from, uint16_t pulse_to) {
+    uint16_t change;
+
+    if (pulse_from == pulse_to)
+        return 0;
+    if (pulse_from == 0)
+        change = SERVO_HIGH_TENSION_US - SERVO_LOW_TENSION_US;
+    else
+        change = pulse_from > pulse_to ? pulse_from - pulse_to : pulse_to - pulse_from;
+    return (change + SERVO_SLEW_US_PER_MS - 1) / SERVO_SLEW_US_PER_MS + SERVO_SETTLE_MS;
 }
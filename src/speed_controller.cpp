@@ -24,22 +24,100 @@
 #include "speed_controller.hpp"
 
 /**
- * @brief Initializes speed controller pin as PWM output
+ * @brief Initializes speed controller pin as PWM output (Timer5) and the control of the DC main motor
  * 
  */
 void speed_controller_setup(void) {
     pinMode(SPEED_CONTROLLER_PIN, OUTPUT);
-    //TCCR5B = TCCR5B & B11111000 | B00000100;
-    //TCCR5B = TCCR5B & B11111000 | B00000101;
+
+    // Phase correct 8-bit PWM (set by Arduino), only the prescaler is changed
+    TCCR5B = (TCCR5B & 0b11111000) | SPEED_CONTROLLER_PWM_PRESCALER;
+    speed_controller_pwm = 0;
     analogWrite(SPEED_CONTROLLER_PIN, 0);
+
+    dc_motor.kp = SPEED_CONTROLLER_KP;
+    dc_motor.ki = SPEED_CONTROLLER_KI;
+    dc_motor.kd = SPEED_CONTROLLER_KD;
+    dc_motor.pwm_min = SPEED_CONTROLLER_PWM_MIN;
+    dc_motor.rpm_max = SPEED_CONTROLLER_RPM_MAX;
+    dc_motor.rpm_positioning = SPEED_CONTROLLER_POSITIONING_RPM;
+    dc_motor.pre_brake_time = SPEED_CONTROLLER_PRE_BRAKE_MS;
+    dc_motor.coast_time = SPEED_CONTROLLER_COAST_MS;
+    dc_motor_reset(&dc_motor);
+    speed_controller_set_speed(SPEED_INITIAL_Z_HZ);
+    speed_controller_set_acceleration(ACCELERATION_INITIAL_Z_HZ);
+}
+
+/**
+ * @brief Runs the speed control (call it from loop())
+ * New needle pulses are sampled by the PID, PWM is written only when it changes
+ * 
+ */
+void speed_controller_update(void) {
+    uint32_t period, count = needle_sensor_get_pulse(&period);
+    uint8_t pwm;
+
+    if (count != speed_controller_pulse_count) {
+        speed_controller_pulse_count = count;
+        dc_motor_pulse(&dc_motor, millis(), period);
+    }
+
+    pwm = dc_motor_update(&dc_motor, millis());
+    if (pwm != speed_controller_pwm)
+        speed_controller_write_speed(pwm);
 }
 
 /**
- * @brief Writes speed to the speed controller
+ * @brief Writes PWM duty to the motor driver
  * 
- * @param speed - 0 to 100
+ * @param pwm - 0 to 255
  */
-void speed_controller_write_speed(uint8_t speed) {
-    digitalWrite(SPEED_CONTROLLER_PIN, speed > 0);
-    //analogWrite(SPEED_CONTROLLER_PIN, map(speed, 0, 100, 0, 255));
-}
\ No newline at end of file
+void speed_controller_write_speed(uint8_t pwm) {
+    speed_controller_pwm = pwm;
+    analogWrite(SPEED_CONTROLLER_PIN, pwm);
+}
+
+/**
+ * @brief Sets target speed of the main motor
+ * 
+ * @param speed_hz - speed in Z motor steps/s (converted to rpm by STEPS_PER_REVOLUTION_Z)
+ */
+void speed_controller_set_speed(uint32_t speed_hz) {
+    dc_motor_set_speed(&dc_motor, speed_hz * 60 / STEPS_PER_REVOLUTION_Z);
+}
+
+/**
+ * @brief Sets speed ramp of the main motor
+ * 
+ * @param acceleration_steps_s - acceleration in Z motor steps/s^2
+ */
+void speed_controller_set_acceleration(int32_t acceleration_steps_s) {
+    dc_motor_set_ramp(&dc_motor, acceleration_steps_s > 0 ? acceleration_steps_s * 60 / STEPS_PER_REVOLUTION_Z : 0);
+}
+
+/**
+ * @brief Starts the main motor
+ * 
+ * @param is_single_stitch - slow down before the needle-up position and stop at the next needle pulse
+ */
+void speed_controller_start(boolean is_single_stitch) {
+    dc_motor_start(&dc_motor, millis(), is_single_stitch);
+}
+
+/**
+ * @brief Cuts the power of the main motor (it coasts to standstill)
+ * 
+ */
+void speed_controller_stop(void) {
+    dc_motor_stop(&dc_motor, millis());
+    speed_controller_write_speed(0);
+}
+
+/**
+ * @brief Checks if the main motor is stopped (coasting time has passed)
+ * 
+ * @return boolean - true if motor is stopped
+ */
+boolean is_speed_controller_stopped() {
+    return dc_motor.state == DC_MOTOR_STATE_STOPPED;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "config.hpp"
+#include "datatypes.hpp"
+#include "speed_governor.hpp"
+
+/**
+ * @brief Starts tuning of the job (call when the file is opened)
+ * 
+ * @param percent - speed settled by the last run of the design (0 - not tuned, starts from the speed of the file)
+ */
+void speed_governor_start(uint8_t percent) {
+    governor_stored = percent;
+    governor_percent = percent > 0 ? percent : 100;
+    if (governor_percent < SPEED_GOVERNOR_MIN_PERCENT)
+        governor_percent = SPEED_GOVERNOR_MIN_PERCENT;
+    else if (governor_percent > SPEED_GOVERNOR_MAX_PERCENT)
+        governor_percent = SPEED_GOVERNOR_MAX_PERCENT;
+    governor_ceiling = SPEED_GOVERNOR_MAX_PERCENT;
+    is_governor_tuned = false;
+
+    governor_stitches = 0;
+    governor_late = 0;
+    governor_missed = 0;
+    governor_missed_count = needle_sensor_get_missed_count();
+    is_governor_move_timed = false;
+}
+
+/**
+ * @brief Scales the needle speed of the stitch by the tuned percentage
+ * 
+ * @param speed - speed from the file or ADAPTIVE_NEEDLE_SPEED (steps/s)
+ * @return uint32_t - speed of the stitch (steps/s), raised speed is limited by SPEED_GOVERNOR_MAX_HZ
+ */
+uint32_t speed_governor_apply(uint32_t speed) {
+    uint32_t scaled = speed * governor_percent / 100;
+
+    if (scaled > speed && scaled > SPEED_GOVERNOR_MAX_HZ)
+        scaled = speed > SPEED_GOVERNOR_MAX_HZ ? speed : SPEED_GOVERNOR_MAX_HZ;
+    return scaled;
+}
+
+/**
+ * @brief Counts the stitch that is being started, checks where the needle stopped after the previous one
+ * 
+ */
+void speed_governor_stitch(void) {
+    int32_t steps;
+
+    // Needle stopped past the needle-up window (the hoop was moving while the needle was going down)
+    if (is_motor_z_stopped()) {
+        steps = needle_sensor_get_steps_since_index() - NEEDLE_UP_OFFSET_STEPS;
+        if (steps > (int32_t)STEPS_PER_REVOLUTION_Z * NEEDLE_UP_WINDOW_PERCENT / 100)
+            governor_late++;
+    }
+
+    if (++governor_stitches >= SPEED_GOVERNOR_WINDOW)
+        speed_governor_decide();
+}
+
+/**
+ * @brief Marks the needle-up interrupt of the stitch (the next move starts now)
+ * 
+ * @param is_needle_running - main motor keeps running (CONTINUOUS_NEEDLE), the move must fit into the window
+ */
+void speed_governor_needle_up(boolean is_needle_running) {
+    uint16_t count = needle_sensor_get_missed_count();
+
+    governor_needle_up_time = micros();
+    is_governor_move_timed = is_needle_running;
+
+    // Missed pulses mean lost sync only while the needle keeps running (in stop-and-go stitching only late stitches
+    // are counted)
+    if (is_needle_running)
+        governor_missed += count - governor_missed_count;
+    governor_missed_count = count;
+}
+
+/**
+ * @brief Checks that the first move after the needle-up interrupt ended inside the needle-up window
+ * 
+ */
+void speed_governor_move_done(void) {
+    uint32_t period;
+
+    if (!is_governor_move_timed)
+        return;
+    is_governor_move_timed = false;
+
+    period = needle_sensor_get_period();
+    if (period > 0 && micros() - governor_needle_up_time > period / 100 * NEEDLE_UP_WINDOW_PERCENT)
+        governor_late++;
+}
+
+/**
+ * @brief Changes the speed at the end of the window by the sync of its stitches
+ * 
+ */
+void speed_governor_decide(void) {
+    // Sync degraded: slow down, this speed isn't tried again
+    if (governor_late > SPEED_GOVERNOR_LATE_STITCHES || governor_missed > 0) {
+        if (governor_percent >= SPEED_GOVERNOR_MIN_PERCENT + SPEED_GOVERNOR_STEP_PERCENT)
+            governor_percent -= SPEED_GOVERNOR_STEP_PERCENT;
+        else
+            governor_percent = SPEED_GOVERNOR_MIN_PERCENT;
+        governor_ceiling = governor_percent;
+    }
+
+    // Clean window: speed up
+    else if (governor_percent + SPEED_GOVERNOR_STEP_PERCENT <= governor_ceiling)
+        governor_percent += SPEED_GOVERNOR_STEP_PERCENT;
+
+#ifdef DEBUG
+    serial->print(F("Governor: late "));
+    serial->print(governor_late);
+    serial->print(F(", missed "));
+    serial->print(governor_missed);
+    serial->print(F(", speed "));
+    serial->print(governor_percent);
+    serial->println(F("%"));
+#endif
+
+    is_governor_tuned = true;
+    governor_stitches = 0;
+    governor_late = 0;
+    governor_missed = 0;
+}
+
+/**
+ * @brief Stores the settled speed of the design for the next run (call when the job is finished or stopped)
+ * 
+ */
+void speed_governor_stop(void) {
+    if (is_governor_tuned && governor_percent != governor_stored) {
+        sd_card_set_needle_speed(governor_percent);
+        governor_stored = governor_percent;
+    }
+    is_governor_tuned = false;
+}
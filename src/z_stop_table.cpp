@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include "config.hpp"
+#include "datatypes.hpp"
+#include "z_stop_table.hpp"
+
+#ifdef Z_STOP_COMPENSATION
+/**
+ * @brief Reads learned Z stops from the EEPROM (the table is empty if it was never stored)
+ * 
+ */
+void z_stop_table_load(void) {
+    uint8_t index;
+
+    // Table is stored with the same size
+    if (EEPROM.read(Z_STOP_TABLE_EEPROM_ADDRESS) == Z_STOP_TABLE_MAGIC
+        && EEPROM.read(Z_STOP_TABLE_EEPROM_ADDRESS + 1) == Z_STOP_TABLE_SIZE) {
+        for (index = 0; index < Z_STOP_TABLE_SIZE; index++)
+            EEPROM.get(Z_STOP_TABLE_EEPROM_ADDRESS + 2 + index * sizeof(z_stop_entry_t), z_stop_table[index]);
+    }
+
+    // Empty table
+    else {
+        for (index = 0; index < Z_STOP_TABLE_SIZE; index++)
+            z_stop_table[index].speed = 0;
+    }
+
+    z_stop_table_next = 0;
+}
+
+/**
+ * @brief Returns learned length of the Z stop
+ * 
+ * @param speed - Z speed (steps/s)
+ * @param acceleration - Z acceleration (steps/s^2)
+ * @return int32_t - steps from the stop command to standstill (-1 if not learned yet)
+ */
+int32_t z_stop_table_get(uint32_t speed, uint32_t acceleration) {
+    int16_t index;
+
+    // Values out of the table range are never learned
+    if (speed > UINT16_MAX || acceleration > UINT16_MAX)
+        return -1;
+
+    index = z_stop_table_find(speed, acceleration);
+    return index < 0 ? -1 : z_stop_table[index].steps;
+}
+
+/**
+ * @brief Adds measured length of the Z stop to the table (averaged with the previous measurements)
+ * 
+ * @param speed - Z speed (steps/s)
+ * @param acceleration - Z acceleration (steps/s^2)
+ * @param steps - steps from the stop command to standstill
+ */
+void z_stop_table_learn(uint32_t speed, uint32_t acceleration, int32_t steps) {
+    int16_t index;
+    z_stop_entry_t stored;
+
+    // Values out of the table range are not learned
+    if (speed == 0 || speed > UINT16_MAX || acceleration > UINT16_MAX || steps < 0 || steps > UINT16_MAX)
+        return;
+
+    index = z_stop_table_find(speed, acceleration);
+
+    // Average with the previous stops (1/4 of the new one)
+    if (index >= 0) {
+        z_stop_table[index].steps = (z_stop_table[index].steps * (uint32_t)3 + steps + 2) / 4;
+
+        // Store only noticeable changes
+        EEPROM.get(Z_STOP_TABLE_EEPROM_ADDRESS + 2 + index * sizeof(z_stop_entry_t), stored);
+        if (abs((int32_t)stored.steps - z_stop_table[index].steps) >= Z_STOP_TABLE_WRITE_STEPS)
+            z_stop_table_save_entry(index);
+        return;
+    }
+
+    // New entry (free one or replace the oldest added one)
+    for (index = 0; index < Z_STOP_TABLE_SIZE && z_stop_table[index].speed != 0; index++);
+    if (index == Z_STOP_TABLE_SIZE) {
+        index = z_stop_table_next;
+        z_stop_table_next = (z_stop_table_next + 1) % Z_STOP_TABLE_SIZE;
+    }
+
+    z_stop_table[index].speed = speed;
+    z_stop_table[index].acceleration = acceleration;
+    z_stop_table[index].steps = steps;
+    z_stop_table_save_entry(index);
+}
+
+/**
+ * @brief Finds entry of the speed and acceleration
+ * 
+ * @return int16_t - index of the entry (-1 if not found)
+ */
+int16_t z_stop_table_find(uint16_t speed, uint16_t acceleration) {
+    for (uint8_t index = 0; index < Z_STOP_TABLE_SIZE; index++)
+        if (z_stop_table[index].speed == speed && z_stop_table[index].acceleration == acceleration)
+            return index;
+    return -1;
+}
+
+/**
+ * @brief Writes entry to the EEPROM (only changed bytes are written)
+ * 
+ * @param index - index of the entry
+ */
+void z_stop_table_save_entry(uint8_t index) {
+    EEPROM.update(Z_STOP_TABLE_EEPROM_ADDRESS, Z_STOP_TABLE_MAGIC);
+    EEPROM.update(Z_STOP_TABLE_EEPROM_ADDRESS + 1, Z_STOP_TABLE_SIZE);
+    EEPROM.put(Z_STOP_TABLE_EEPROM_ADDRESS + 2 + index * sizeof(z_stop_entry_t), z_stop_table[index]);
+}
+#endif
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// Host-side helpers shared by the tools: reads Tajima .dst designs and generates
+// G-code in the same way as OpenEmbroidery.py does with its default GUI settings
+
+#ifndef DST_DESIGN_H
+#define DST_DESIGN_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#define DST_HEADER_SIZE 512
+
+#define DST_STITCH 0
+#define DST_JUMP 1
+#define DST_COLOR_CHANGE 2
+#define DST_END 3
+
+// Default values of the OpenEmbroidery.py GUI (gui.ui)
+#define DESIGN_SCALING_FACTOR 10.
+#define DESIGN_JUMP_SPEED 30
+#define DESIGN_STITCH_SPEED 150
+#define DESIGN_Z_LOW_SPEED 700
+#define DESIGN_Z_HIGH_SPEED 1800
+#define DESIGN_ACCELERATION_X 800
+#define DESIGN_ACCELERATION_Y 800
+#define DESIGN_ACCELERATION_Z_MAX 20000
+
+// Single stitch of the design (absolute position in 0.1 mm, Y axis points down as in pyembroidery)
+typedef struct {
+    int32_t x, y;
+    uint8_t type;
+} dst_stitch_t;
+
+/**
+ * @brief Decodes X and Y offsets of the 3-byte DST record
+ */
+static inline void dst_decode_record(const uint8_t *r, int32_t *dx, int32_t *dy) {
+    *dx = 0;
+    *dy = 0;
+    if (r[0] & 0x01) *dx += 1;
+    if (r[0] & 0x02) *dx -= 1;
+    if (r[0] & 0x04) *dx += 9;
+    if (r[0] & 0x08) *dx -= 9;
+    if (r[1] & 0x01) *dx += 3;
+    if (r[1] & 0x02) *dx -= 3;
+    if (r[1] & 0x04) *dx += 27;
+    if (r[1] & 0x08) *dx -= 27;
+    if (r[2] & 0x04) *dx += 81;
+    if (r[2] & 0x08) *dx -= 81;
+    if (r[0] & 0x80) *dy += 1;
+    if (r[0] & 0x40) *dy -= 1;
+    if (r[0] & 0x20) *dy += 9;
+    if (r[0] & 0x10) *dy -= 9;
+    if (r[1] & 0x80) *dy += 3;
+    if (r[1] & 0x40) *dy -= 3;
+    if (r[1] & 0x20) *dy += 27;
+    if (r[1] & 0x10) *dy -= 27;
+    if (r[2] & 0x20) *dy += 81;
+    if (r[2] & 0x10) *dy -= 81;
+}
+
+/**
+ * @brief Reads all stitches of the DST file
+ *
+ * @return bool - true if the file is read
+ */
+static inline bool dst_read(const char *path, std::vector<dst_stitch_t> &stitches) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    uint8_t record[3];
+    int32_t x = 0, y = 0, dx, dy;
+    dst_stitch_t stitch;
+
+    stitches.clear();
+    fseek(f, DST_HEADER_SIZE, SEEK_SET);
+    while (fread(record, 1, 3, f) == 3) {
+        // End of design
+        if (record[2] == 0xF3) {
+            stitch.x = x;
+            stitch.y = y;
+            stitch.type = DST_END;
+            stitches.push_back(stitch);
+            break;
+        }
+
+        dst_decode_record(record, &dx, &dy);
+        x += dx;
+        y -= dy;
+
+        stitch.x = x;
+        stitch.y = y;
+        if ((record[2] & 0xC3) == 0xC3)
+            stitch.type = DST_COLOR_CHANGE;
+        else if (record[2] & 0x80)
+            stitch.type = DST_JUMP;
+        else
+            stitch.type = DST_STITCH;
+        stitches.push_back(stitch);
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * @brief Formats coordinate in the same way as str(round(x, 2)) in Python
+ */
+static inline std::string design_format_coordinate(double value) {
+    char text[32];
+    value = round(value * 100.) / 100.;
+    if (value == floor(value))
+        snprintf(text, sizeof(text), "%.1f", value);
+    else {
+        snprintf(text, sizeof(text), "%.2f", value);
+        if (text[strlen(text) - 1] == '0')
+            text[strlen(text) - 1] = 0;
+    }
+    return text;
+}
+
+/**
+ * @brief Generates G-code from stitches (mirrors Window.gcode_generate() of OpenEmbroidery.py)
+ *
+ * @return std::string - G-code text (lines separated with \n)
+ */
+static inline std::string design_to_gcode(const std::vector<dst_stitch_t> &stitches) {
+    std::string gcode;
+    const int acceleration_z_low = (int)(DESIGN_ACCELERATION_Z_MAX
+                                         / pow((double)DESIGN_Z_HIGH_SPEED / DESIGN_Z_LOW_SPEED, 2));
+    const std::string acceleration_low = "M201 X" + std::to_string(DESIGN_ACCELERATION_X)
+                                         + " Y" + std::to_string(DESIGN_ACCELERATION_Y)
+                                         + " Z" + std::to_string(acceleration_z_low) + "\n";
+    const std::string acceleration_high = "M201 X" + std::to_string(DESIGN_ACCELERATION_X)
+                                          + " Y" + std::to_string(DESIGN_ACCELERATION_Y)
+                                          + " Z" + std::to_string(DESIGN_ACCELERATION_Z_MAX) + "\n";
+    const std::string jump_feed = " F" + std::to_string(DESIGN_JUMP_SPEED) + "\n";
+    const std::string stitch_feed = " F" + std::to_string(DESIGN_STITCH_SPEED) + "\n";
+    bool is_thread_pulled_out = false, is_thread_tensioned = false;
+    int stitch_counter = 0, color_counter = 1, progress_last = 0;
+    double x_min = INFINITY, y_min = INFINITY, x_max = -INFINITY, y_max = -INFINITY;
+
+    auto set_tension = [&](bool tension) {
+        if (tension && !is_thread_tensioned) {
+            gcode += "M42\nG4 P500\n";
+            is_thread_tensioned = true;
+        }
+        else if (!tension && is_thread_tensioned) {
+            gcode += "M41\nG4 P500\n";
+            is_thread_tensioned = false;
+        }
+    };
+
+    gcode += "; design\nM17\nM73 P0\n" + acceleration_low + "G4 P500\n";
+
+    // Min and max points
+    for (const dst_stitch_t &stitch : stitches) {
+        double x = round(stitch.x / DESIGN_SCALING_FACTOR * 100.) / 100.;
+        double y = round(stitch.y / DESIGN_SCALING_FACTOR * 100.) / 100.;
+        x_min = fmin(x_min, x);
+        y_min = fmin(y_min, y);
+        x_max = fmax(x_max, x);
+        y_max = fmax(y_max, y);
+    }
+    gcode += "G0 X" + design_format_coordinate(x_min) + " Y" + design_format_coordinate(y_min) + jump_feed + "G4 P500\n";
+    gcode += "G0 X" + design_format_coordinate(x_min) + " Y" + design_format_coordinate(y_max) + jump_feed + "G4 P500\n";
+    gcode += "G0 X" + design_format_coordinate(x_max) + " Y" + design_format_coordinate(y_max) + jump_feed + "G4 P500\n";
+    gcode += "G0 X" + design_format_coordinate(x_max) + " Y" + design_format_coordinate(y_min) + jump_feed + "G4 P1000\n";
+    gcode += "G0 X0 Y0" + jump_feed + "G4 P500\n";
+    gcode += "M0 C" + std::to_string(color_counter) + "\n";
+
+    for (size_t i = 0; i < stitches.size(); i++) {
+        const dst_stitch_t &stitch = stitches[i];
+        const std::string position = "X" + design_format_coordinate(stitch.x / DESIGN_SCALING_FACTOR)
+                                     + " Y" + design_format_coordinate(stitch.y / DESIGN_SCALING_FACTOR);
+        int progress = (int)(i * 100 / stitches.size());
+        if (progress - progress_last >= 1) {
+            progress_last = progress;
+            gcode += "M73 P" + std::to_string(progress) + "\n";
+        }
+
+        if (stitch.type != DST_STITCH) {
+            stitch_counter = 0;
+            gcode += "M5\n";
+            set_tension(false);
+        }
+
+        switch (stitch.type) {
+            case DST_STITCH:
+                if (!is_thread_pulled_out) {
+                    gcode += "G0 " + position + jump_feed;
+                    set_tension(false);
+                    gcode += "M0 C100\n";
+                    is_thread_pulled_out = true;
+                    is_thread_tensioned = false;
+                }
+                set_tension(true);
+                gcode += "G1 " + position + stitch_feed;
+                if (stitch_counter == 0)
+                    gcode += acceleration_low;
+                if (stitch_counter <= 5) {
+                    gcode += "M3 S" + std::to_string(DESIGN_Z_LOW_SPEED) + " I1\n";
+                    stitch_counter++;
+                }
+                else {
+                    if (stitch_counter == 6) {
+                        gcode += acceleration_high;
+                        stitch_counter++;
+                    }
+                    gcode += "M3 S" + std::to_string(DESIGN_Z_HIGH_SPEED) + " I1\n";
+                }
+                if (stitch_counter == 5) {
+                    gcode += "M0 C101\n";
+                    stitch_counter++;
+                }
+                break;
+
+            case DST_COLOR_CHANGE:
+                color_counter++;
+                gcode += "M0 C" + std::to_string(color_counter) + "\n";
+                gcode += "G0 " + position + jump_feed;
+                is_thread_pulled_out = false;
+                break;
+
+            default:
+                gcode += "G0 " + position + jump_feed;
+                break;
+        }
+    }
+
+    gcode += "M5\nM18\n";
+    return gcode;
+}
+
+/**
+ * @brief Reads .dst design (converting it to G-code) or .gcode file as is
+ *
+ * @return bool - true if the file is read
+ */
+static inline bool design_load_gcode(const char *path, std::string &gcode) {
+    size_t length = strlen(path);
+    if (length > 4 && (strcmp(path + length - 4, ".dst") == 0 || strcmp(path + length - 4, ".DST") == 0)) {
+        std::vector<dst_stitch_t> stitches;
+        if (!dst_read(path, stitches))
+            return false;
+        gcode = design_to_gcode(stitches);
+        return true;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    char chunk[4096];
+    size_t size;
+    gcode.clear();
+    while ((size = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        gcode.append(chunk, size);
+    fclose(f);
+    return true;
+}
+
+/**
+ * @brief Splits G-code into lines (each line keeps its \n, as fgets does)
+ */
+static inline std::vector<std::string> design_split_lines(const std::string &gcode) {
+    std::vector<std::string> lines;
+    size_t start = 0, end;
+    while (start < gcode.size()) {
+        end = gcode.find('\n', start);
+        if (end == std::string::npos)
+            end = gcode.size() - 1;
+        lines.push_back(gcode.substr(start, end - start + 1));
+        start = end + 1;
+    }
+    return lines;
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// Host-side microbenchmark of the G-code line parsing
+// Compares the old gcode_parse_code() rescans (atof) with the single-pass fixed-point tokenizer (src/gcode_parser.cpp)
+//
+// Build: g++ -O2 -I include -o gcode_bench tools/gcode_bench.cpp src/gcode_parser.cpp
+// Usage: ./gcode_bench examples/*.dst [file.gcode ...]
+
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+#include "dst_design.hpp"
+#include "gcode_parser.hpp"
+
+// Same size as the former firmware line buffer
+#define LINE_BUFFER_SIZE 50
+
+#define ITERATIONS 50
+
+static char buffer[LINE_BUFFER_SIZE];
+static gcode_words_t words;
+
+/**
+ * @brief Copy of the previous gcode_parse_code() implementation
+ */
+static float legacy_parse_code(char code, float default_value) {
+    char *ptr = buffer;
+    while ((long)ptr > 1 && (*ptr) && (long)ptr < (long)buffer + (long)strlen(buffer)) {
+        if (*ptr == code)
+            return atof(ptr + 1);
+        else if (*ptr == ';')
+            return default_value;
+        ptr = strchr(ptr, ' ') + 1;
+    }
+    return default_value;
+}
+
+/**
+ * @brief Requests codes in the same order as gcode_cycle() does
+ *
+ * @return float - sum of the parsed values (to compare implementations and keep the calls alive)
+ */
+template <typename parse_t> static float handle_line(parse_t parse) {
+    float sum = 0;
+    int command = parse('G', -1);
+    sum += command;
+    if (command == 0 || command == 1)
+        sum += parse('X', 0) + parse('Y', 0) + parse('F', 0);
+    else if (command == 4)
+        sum += parse('P', 0);
+
+    command = parse('M', -1);
+    sum += command;
+    if (command == 0)
+        sum += parse('C', 0);
+    else if (command == 3)
+        sum += parse('S', 0) + parse('I', 0);
+    else if (command == 73)
+        sum += parse('P', 0);
+    else if (command == 201)
+        sum += parse('X', 0) + parse('Y', 0) + parse('Z', 0);
+    return sum;
+}
+
+static inline uint64_t bench_cycles(void) {
+#ifdef BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s design.dst|design.gcode ...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-28s %8s %14s %14s %14s %14s %8s\n", "file", "lines", "legacy ns/ln", "token ns/ln",
+           "legacy cyc/ln", "token cyc/ln", "speedup");
+
+    for (int i = 1; i < argc; i++) {
+        std::string gcode;
+        if (!design_load_gcode(argv[i], gcode)) {
+            fprintf(stderr, "Can't read %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<std::string> lines = design_split_lines(gcode);
+
+        float sum_legacy = 0, sum_tokenizer = 0;
+        uint64_t cycles_legacy = 0, cycles_tokenizer = 0, cycles_start;
+        std::chrono::nanoseconds time_legacy(0), time_tokenizer(0);
+        std::chrono::steady_clock::time_point time_start;
+
+        for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+            // Old implementation: every code rescans the line
+            time_start = std::chrono::steady_clock::now();
+            cycles_start = bench_cycles();
+            for (const std::string &line : lines) {
+                strncpy(buffer, line.c_str(), sizeof(buffer) - 1);
+                sum_legacy += handle_line(legacy_parse_code);
+            }
+            cycles_legacy += bench_cycles() - cycles_start;
+            time_legacy += std::chrono::steady_clock::now() - time_start;
+
+            // Single-pass tokenizer and lookups
+            time_start = std::chrono::steady_clock::now();
+            cycles_start = bench_cycles();
+            for (const std::string &line : lines) {
+                strncpy(buffer, line.c_str(), sizeof(buffer) - 1);
+                gcode_parser_tokenize(buffer, &words);
+                sum_tokenizer += handle_line([](char code, float default_value) {
+                    return gcode_parser_get(&words, code, (int32_t)default_value * GCODE_FIXED_SCALE)
+                           / (float)GCODE_FIXED_SCALE;
+                });
+            }
+            cycles_tokenizer += bench_cycles() - cycles_start;
+            time_tokenizer += std::chrono::steady_clock::now() - time_start;
+        }
+
+        if (fabsf(sum_legacy - sum_tokenizer) > fabsf(sum_legacy) * 1e-5f) {
+            fprintf(stderr, "%s: parsed values mismatch (%f != %f)\n", argv[i], sum_legacy, sum_tokenizer);
+            return 1;
+        }
+
+        double count = (double)lines.size() * ITERATIONS;
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        printf("%-28s %8zu %14.1f %14.1f %14.1f %14.1f %7.2fx\n", name, lines.size(),
+               time_legacy.count() / count, time_tokenizer.count() / count,
+               cycles_legacy / count, cycles_tokenizer / count,
+               (double)time_legacy.count() / (double)time_tokenizer.count());
+    }
+    return 0;
+}
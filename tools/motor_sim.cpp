@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// Host-side simulation of the DC main motor control (DC_MAIN_MOTOR)
+// Runs the firmware controller (src/dc_motor.cpp) against a model of a sewing machine with a DC motor: inertia,
+// PWM drive with back-EMF, friction and the load of the needle going through the fabric in part of each revolution.
+// The needle sensor gives one pulse per revolution at the needle-up position. Reports the step response of the
+// continuous run (rise time, overshoot, speed ripple) and the stop position of single stitches with and without
+// pre-braking. Default gains and times are the same as include/config.hpp
+//
+// Build: g++ -O2 -I include -o motor_sim tools/motor_sim.cpp src/dc_motor.cpp
+// Usage: ./motor_sim [-p kp] [-i ki] [-d kd] [-r rpm] [-s single_stitch_rpm] [-v positioning_rpm] [-b pre_brake_ms]
+//                    [-l load]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dc_motor.hpp"
+
+// Same as include/config.hpp
+#define KP 48
+#define KI 96
+#define KD 2
+#define PWM_MIN 40
+#define RPM_MAX 1000
+#define RPM_POSITIONING 90
+#define PRE_BRAKE_MS 200
+#define COAST_MS 200
+#define RAMP_RPM_S 6000
+#define NEEDLE_SENSOR_TIMEOUT_US 1000000
+
+// Model: no-load speed at full PWM (rpm), mechanical time constant (s), friction and needle load (part of full
+// PWM torque), part of the revolution with the needle in the fabric
+#define MODEL_RPM_MAX 1100.
+#define MODEL_TAU 0.08
+#define MODEL_FRICTION 0.1
+#define MODEL_LOAD 0.12
+#define MODEL_LOAD_START 0.35
+#define MODEL_LOAD_END 0.65
+
+// Simulation step and controller period (loop() calls, s)
+#define STEP 0.0001
+#define UPDATE 0.001
+
+typedef struct {
+    double time, speed, angle;       // s, rpm, revolutions
+    double pulse_time;               // s (-1 - no pulse yet)
+    double load;
+} model_t;
+
+/**
+ * @brief Advances the model by one step
+ * 
+ * @param model - model state
+ * @param pwm - 0 to 255
+ * @return bool - true if the needle sensor pulse (needle-up) was passed
+ */
+static bool model_step(model_t *model, uint8_t pwm) {
+    double phase = model->angle - floor(model->angle);
+    double drive = 0, brake = MODEL_FRICTION;
+    double angle_last = model->angle;
+
+    // Motor current can't reverse (PWM off - the motor freewheels)
+    if (pwm > 0 && pwm / 255. * MODEL_RPM_MAX > model->speed)
+        drive = pwm / 255. - model->speed / MODEL_RPM_MAX;
+    if (phase >= MODEL_LOAD_START && phase < MODEL_LOAD_END)
+        brake += model->load;
+
+    // Friction and load hold the motor at standstill
+    if (model->speed <= 0 && drive <= brake) {
+        model->speed = 0;
+        model->time += STEP;
+        return false;
+    }
+    model->speed += (drive - brake) * MODEL_RPM_MAX / MODEL_TAU * STEP;
+    if (model->speed < 0)
+        model->speed = 0;
+    model->angle += model->speed / 60. * STEP;
+    model->time += STEP;
+    return floor(model->angle) > floor(angle_last);
+}
+
+/**
+ * @brief Runs the model and the controller for the given time
+ * 
+ * @param model - model state
+ * @param motor - controller state
+ * @param duration - s (the run ends earlier when the motor stops if until_stop is set)
+ * @param until_stop - end when the controller is stopped and the model stands still
+ * @param trace - called at every pulse with the measured speed (can be NULL)
+ */
+static void simulate(model_t *model, dc_motor_t *motor, double duration, bool until_stop,
+                     void (*trace)(model_t *model, dc_motor_t *motor)) {
+    double end = model->time + duration, next_update = model->time;
+    uint8_t pwm = motor->pwm;
+    uint32_t period;
+
+    while (model->time < end) {
+        if (model->time >= next_update) {
+            pwm = dc_motor_update(motor, (uint32_t)(model->time * 1000));
+            next_update += UPDATE;
+        }
+        if (model_step(model, pwm)) {
+            period = model->pulse_time < 0 ? 0 : (uint32_t)((model->time - model->pulse_time) * 1e6);
+            if (period >= NEEDLE_SENSOR_TIMEOUT_US)
+                period = 0;
+            model->pulse_time = model->time;
+            dc_motor_pulse(motor, (uint32_t)(model->time * 1000), period);
+            pwm = motor->pwm;
+            if (trace != NULL)
+                trace(model, motor);
+        }
+        if (until_stop && motor->state == DC_MOTOR_STATE_STOPPED && model->speed == 0)
+            break;
+    }
+}
+
+// Speed statistics of the continuous run
+static double trace_from, trace_target, trace_start, trace_rise, trace_peak, trace_min, trace_max;
+
+static void trace_speed(model_t *model, dc_motor_t *motor) {
+    if (motor->rpm == 0)
+        return;
+    // Overshoot is in the direction of the speed change
+    if (trace_rise < 0 && fabs(motor->rpm - trace_target) <= fabs(trace_target - trace_from) * 0.1)
+        trace_rise = model->time - trace_start;
+    if ((motor->rpm - trace_target) * (trace_target - trace_from) > trace_peak)
+        trace_peak = (motor->rpm - trace_target) * (trace_target - trace_from);
+    if (model->time - trace_start >= 1.5) {
+        if (motor->rpm < trace_min)
+            trace_min = motor->rpm;
+        if (motor->rpm > trace_max)
+            trace_max = motor->rpm;
+    }
+}
+
+/**
+ * @brief Runs continuously at the speed, reports rise time, overshoot and ripple after settling
+ * 
+ * @param model - model state
+ * @param motor - controller state
+ * @param rpm - target speed
+ */
+static void run_continuous(model_t *model, dc_motor_t *motor, uint16_t rpm) {
+    trace_from = model->speed;
+    trace_target = rpm;
+    trace_start = model->time;
+    trace_rise = -1;
+    trace_peak = 0;
+    trace_min = 1e9;
+    trace_max = 0;
+
+    if (motor->state == DC_MOTOR_STATE_STOPPED)
+        dc_motor_start(motor, (uint32_t)(model->time * 1000), false);
+    dc_motor_set_speed(motor, rpm);
+    simulate(model, motor, 3, false, trace_speed);
+
+    printf("continuous %4u rpm: rise %5.0f ms, overshoot %5.1f%% of the step, measured %4.0f..%4.0f rpm, PWM %3u, "
+           "integral %4d\n", rpm, trace_rise * 1000, trace_peak / pow(trace_target - trace_from, 2) * 100, trace_min, trace_max,
+           motor->pwm, motor->integral >> DC_MOTOR_GAIN_BITS);
+}
+
+/**
+ * @brief Makes single stitches, reports the stop position after the needle-up pulse
+ * 
+ * @param motor - controller state (gains)
+ * @param load - needle load
+ * @param rpm - stitch speed
+ * @param pre_brake - time at the positioning speed (ms, 0 - no pre-braking)
+ * @param count - stitches
+ */
+static void run_single(dc_motor_t *motor, double load, uint16_t rpm, uint16_t pre_brake, int count) {
+    uint16_t rpm_positioning = motor->rpm_positioning;
+    model_t model = {0, 0, 0, -1, load};
+    double overshoot, overshoot_sum = 0, overshoot_max = 0, duration_sum = 0, start;
+    int measured = 0;
+
+    dc_motor_reset(motor);
+    motor->pre_brake_time = pre_brake;
+    if (pre_brake == 0)
+        motor->rpm_positioning = rpm;
+    dc_motor_set_speed(motor, rpm);
+
+    for (int i = 0; i < count; i++) {
+        start = model.time;
+        dc_motor_start(motor, (uint32_t)(model.time * 1000), true);
+        simulate(&model, motor, 5, true, NULL);
+
+        // Learning of the pre-braking time settles in a few stitches
+        overshoot = (model.angle - floor(model.angle)) * 360;
+        if (i >= 10) {
+            overshoot_sum += overshoot;
+            overshoot_max = fmax(overshoot_max, overshoot);
+            duration_sum += model.time - start;
+            measured++;
+        }
+        simulate(&model, motor, 0.05, false, NULL);
+    }
+
+    printf("single %4u rpm, pre-brake %3u ms: stop %5.1f deg after needle-up (max %5.1f), stitch %4.0f ms "
+           "(learned %u ms)\n", rpm, pre_brake, overshoot_sum / measured, overshoot_max,
+           duration_sum / measured * 1000, motor->stitch_time);
+    motor->rpm_positioning = rpm_positioning;
+}
+
+int main(int argc, char **argv) {
+    dc_motor_t motor;
+    uint16_t rpm = 540, rpm_single = 210, rpm_positioning = RPM_POSITIONING, pre_brake = PRE_BRAKE_MS;
+    double load = MODEL_LOAD;
+
+    memset(&motor, 0, sizeof(motor));
+    motor.kp = KP;
+    motor.ki = KI;
+    motor.kd = KD;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-p") == 0)
+            motor.kp = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-i") == 0)
+            motor.ki = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-d") == 0)
+            motor.kd = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0)
+            rpm = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0)
+            rpm_single = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-v") == 0)
+            rpm_positioning = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-b") == 0)
+            pre_brake = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-l") == 0)
+            load = atof(argv[i + 1]);
+        else {
+            fprintf(stderr, "Usage: %s [-p kp] [-i ki] [-d kd] [-r rpm] [-s single_stitch_rpm] [-v positioning_rpm] "
+                    "[-b pre_brake_ms] [-l load]\n", argv[0]);
+            return 1;
+        }
+    }
+    motor.pwm_min = PWM_MIN;
+    motor.rpm_max = RPM_MAX;
+    motor.rpm_positioning = rpm_positioning;
+    motor.pre_brake_time = pre_brake;
+    motor.coast_time = COAST_MS;
+
+    printf("kp %u, ki %u, kd %u (1/256 of PWM), needle load %.2f\n", motor.kp, motor.ki, motor.kd, load);
+
+    // Start from standstill, speed steps up and down
+    model_t model = {0, 0, 0, -1, load};
+    dc_motor_reset(&motor);
+    dc_motor_set_ramp(&motor, RAMP_RPM_S);
+    run_continuous(&model, &motor, rpm);
+    run_continuous(&model, &motor, rpm * 3 / 2 < RPM_MAX ? rpm * 3 / 2 : RPM_MAX);
+    run_continuous(&model, &motor, rpm / 2);
+
+    run_single(&motor, load, rpm_single, 0, 40);
+    run_single(&motor, load, rpm_single, pre_brake, 40);
+    run_single(&motor, load, rpm, 0, 40);
+    run_single(&motor, load, rpm, pre_brake, 40);
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// Host-side packer of the binary stitch format (include/oeb_format.hpp)
+// Converts G-code (or .dst design via G-code) into .OEB file that the firmware plays without text parsing
+//
+// Build: g++ -O2 -I include -o oeb_pack tools/oeb_pack.cpp src/gcode_parser.cpp
+// Usage: ./oeb_pack [-x steps_per_mm_x] [-y steps_per_mm_y] design.dst|design.gcode output.oeb
+
+#include <stdlib.h>
+
+#include "dst_design.hpp"
+#include "gcode_parser.hpp"
+#include "oeb_format.hpp"
+
+// Same as STEPS_PER_MM_X, STEPS_PER_MM_Y and ACCELERATION_INITIAL_Z_HZ in config.hpp
+#define PACK_STEPS_PER_MM_X 90
+#define PACK_STEPS_PER_MM_Y 65
+#define PACK_ACCELERATION_Z_DEFAULT 10000
+
+// Order of the actions inside one move record (see include/oeb_format.hpp)
+#define PACK_STAGE_NONE 0
+#define PACK_STAGE_TRIM 1
+#define PACK_STAGE_PAUSE 2
+#define PACK_STAGE_TENSION 3
+#define PACK_STAGE_MOVE 4
+#define PACK_STAGE_STITCH 5
+
+// Setting is not known yet (the firmware uses its initial value)
+#define PACK_UNKNOWN 0xFFFFFFFF
+
+static_assert(sizeof(oeb_header_t) == 32, "Header must be 32 bytes");
+static_assert(sizeof(oeb_record_t) == 8, "Record must be 8 bytes");
+
+typedef struct {
+    FILE *file;
+    oeb_header_t header;
+
+    // Record that is being filled and the last action added to it
+    oeb_record_t pending;
+    uint8_t stage;
+
+    // Current state as the firmware reader will see it
+    bool is_tensioned;
+    int32_t x, y;
+    uint32_t jump_speed, stitch_speed, acceleration_x, acceleration_y, acceleration_z;
+
+    // Dwell after tension change
+    bool is_tension_changed;
+
+    // Bounding box starts from the first move
+    bool is_bounding_box_known;
+} pack_state_t;
+
+/**
+ * @brief Writes record to the output file
+ */
+static void pack_write(pack_state_t *state, const oeb_record_t *record) {
+    fwrite(record, sizeof(oeb_record_t), 1, state->file);
+    state->header.record_count++;
+}
+
+/**
+ * @brief Writes pending record (if any) and starts a new one
+ */
+static void pack_flush(pack_state_t *state) {
+    if (state->stage != PACK_STAGE_NONE) {
+        pack_write(state, &state->pending);
+        if (state->pending.flags & OEB_FLAG_STITCH)
+            state->header.stitch_count++;
+    }
+
+    memset(&state->pending, 0, sizeof(state->pending));
+    state->pending.flags = state->is_tensioned ? OEB_FLAG_TENSION : 0;
+    state->stage = PACK_STAGE_NONE;
+}
+
+/**
+ * @brief Adds action to the pending record (starts a new record if the action can't be executed after the previous ones)
+ */
+static void pack_stage(pack_state_t *state, uint8_t stage) {
+    if (state->stage >= stage)
+        pack_flush(state);
+    state->stage = stage;
+}
+
+/**
+ * @brief Writes control record
+ * 
+ * @param stage - first stage of the pending record affected by this setting (it is written after the pending record)
+ */
+static void pack_control(pack_state_t *state, uint8_t code, uint32_t argument, uint8_t stage) {
+    oeb_record_t record;
+
+    if (state->stage >= stage || (stage == PACK_STAGE_STITCH && (state->pending.flags & OEB_FLAG_TRIM)))
+        pack_flush(state);
+
+    record.flags = OEB_FLAG_CONTROL;
+    record.code = code;
+    record.dx = (int16_t)(argument & 0xFFFF);
+    record.dy = (int16_t)(argument >> 16);
+    record.value = 0;
+    pack_write(state, &record);
+}
+
+/**
+ * @brief Converts mm (hundredths) to steps in the same way as motors_fixed_to_steps()
+ */
+static int32_t pack_fixed_to_steps(int32_t value, int32_t steps_per_mm) {
+    int64_t product = (int64_t)value * steps_per_mm;
+    return (int32_t)((product + (product >= 0 ? GCODE_FIXED_SCALE / 2 : -GCODE_FIXED_SCALE / 2)) / GCODE_FIXED_SCALE);
+}
+
+/**
+ * @brief Finds the shortest dwell after tension changes (the firmware waits header.tension_dwell after each change,
+ * longer dwells are completed with control records)
+ * 
+ * @return uint16_t - dwell (ms), 0 if some change has no dwell after it
+ */
+static uint16_t pack_get_tension_dwell(const std::vector<std::string> &lines) {
+    gcode_words_t words;
+    uint32_t dwell, tension_dwell = UINT16_MAX;
+    int32_t m_code;
+    bool is_tensioned = false, is_tension_changed = false;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        gcode_parser_tokenize(lines[i].c_str(), &words);
+
+        // Dwell directly after tension change (G4 on the next line)
+        if (is_tension_changed) {
+            dwell = gcode_parser_get(&words, 'G', -GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE == 4
+                ? gcode_parser_get(&words, 'P', 0) / GCODE_FIXED_SCALE : 0;
+            if (dwell < tension_dwell)
+                tension_dwell = dwell;
+            is_tension_changed = false;
+        }
+
+        // Only real changes, the firmware skips the rest
+        m_code = gcode_parser_get(&words, 'M', -GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE;
+        if ((m_code == 41 || m_code == 42) && (m_code == 42) != is_tensioned) {
+            is_tensioned = m_code == 42;
+            is_tension_changed = true;
+        }
+    }
+
+    // Tension change at the end of the file or no changes at all
+    if (is_tension_changed || tension_dwell == UINT16_MAX)
+        tension_dwell = 0;
+    return tension_dwell;
+}
+
+/**
+ * @brief Packs G-code lines into the output file
+ * 
+ * @return bool - false if G-code can't be represented by the format
+ */
+static bool pack_gcode(pack_state_t *state, const std::vector<std::string> &lines) {
+    gcode_words_t words;
+    int32_t x_fixed = 0, y_fixed = 0, x_steps, y_steps, dx, dy;
+    uint32_t feed = PACK_UNKNOWN, acceleration_x = PACK_UNKNOWN, acceleration_y = PACK_UNKNOWN, dwell, code;
+    int32_t g_code, m_code;
+    bool is_jump;
+
+    state->header.tension_dwell = pack_get_tension_dwell(lines);
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        gcode_parser_tokenize(lines[i].c_str(), &words);
+        g_code = gcode_parser_get(&words, 'G', -GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE;
+        m_code = gcode_parser_get(&words, 'M', -GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE;
+
+        // Dwell directly after tension change: the shortest one is stored in the header, the rest is added
+        if (state->is_tension_changed) {
+            dwell = 0;
+            if (g_code == 4) {
+                dwell = gcode_parser_get(&words, 'P', 0) / GCODE_FIXED_SCALE;
+                g_code = -1;
+            }
+            if (dwell > state->header.tension_dwell)
+                pack_control(state, OEB_CONTROL_DWELL, dwell - state->header.tension_dwell, PACK_STAGE_TRIM);
+            state->is_tension_changed = false;
+        }
+
+        switch (g_code)
+        {
+        case 0:
+        case 1:
+            // G0, G1 - interpolation movement
+            x_fixed = gcode_parser_get(&words, 'X', x_fixed);
+            y_fixed = gcode_parser_get(&words, 'Y', y_fixed);
+            if (words.mask & GCODE_WORD_BIT('F'))
+                feed = gcode_parser_get(&words, 'F', 0) / GCODE_FIXED_SCALE;
+
+            // Speed of the move
+            is_jump = g_code == 0;
+            if (feed != PACK_UNKNOWN && feed != (is_jump ? state->jump_speed : state->stitch_speed)) {
+                pack_control(state, is_jump ? OEB_CONTROL_JUMP_SPEED : OEB_CONTROL_STITCH_SPEED, feed, PACK_STAGE_MOVE);
+                if (is_jump)
+                    state->jump_speed = feed;
+                else
+                    state->stitch_speed = feed;
+            }
+
+            // Zero-length moves are skipped by the firmware
+            x_steps = pack_fixed_to_steps(x_fixed, state->header.steps_per_mm_x);
+            y_steps = pack_fixed_to_steps(y_fixed, state->header.steps_per_mm_y);
+            dx = x_steps - state->x;
+            dy = y_steps - state->y;
+            if (dx == 0 && dy == 0)
+                break;
+
+            if (dx < INT16_MIN || dx > INT16_MAX || dy < INT16_MIN || dy > INT16_MAX
+                || x_steps < INT16_MIN || x_steps > INT16_MAX || y_steps < INT16_MIN || y_steps > INT16_MAX) {
+                fprintf(stderr, "Line %zu: move is out of range\n", i + 1);
+                return false;
+            }
+
+            pack_stage(state, PACK_STAGE_MOVE);
+            state->pending.flags |= is_jump ? OEB_FLAG_JUMP : 0;
+            state->pending.dx = dx;
+            state->pending.dy = dy;
+            state->x = x_steps;
+            state->y = y_steps;
+
+            // Bounding box
+            if (!state->is_bounding_box_known) {
+                state->header.x_min = state->header.x_max = x_steps;
+                state->header.y_min = state->header.y_max = y_steps;
+                state->is_bounding_box_known = true;
+            }
+            if (x_steps < state->header.x_min) state->header.x_min = x_steps;
+            if (y_steps < state->header.y_min) state->header.y_min = y_steps;
+            if (x_steps > state->header.x_max) state->header.x_max = x_steps;
+            if (y_steps > state->header.y_max) state->header.y_max = y_steps;
+            break;
+
+        case 4:
+            // G4 - Delay (Dwell)
+            pack_control(state, OEB_CONTROL_DWELL, gcode_parser_get(&words, 'P', 0) / GCODE_FIXED_SCALE,
+                PACK_STAGE_TRIM);
+            break;
+
+        default:
+            break;
+        }
+
+        switch (m_code)
+        {
+        case 0:
+            // M0 - Pause
+            code = gcode_parser_get(&words, 'C', 0) / GCODE_FIXED_SCALE;
+            if (code > 0xFF) {
+                fprintf(stderr, "Line %zu: pause code is out of range\n", i + 1);
+                return false;
+            }
+            pack_stage(state, PACK_STAGE_PAUSE);
+            state->pending.flags |= OEB_FLAG_PAUSE;
+            state->pending.code = code;
+
+            // Color change
+            if (code > 0 && code < 100)
+                state->header.color_count++;
+            break;
+
+        case 3:
+            // M3 - Start motor (only single stitches are supported)
+            if (gcode_parser_get(&words, 'I', 0) <= 0) {
+                fprintf(stderr, "Line %zu: continuous rotation (M3 without I1) is not supported\n", i + 1);
+                return false;
+            }
+            pack_stage(state, PACK_STAGE_STITCH);
+            state->pending.flags |= OEB_FLAG_STITCH;
+            state->pending.value = gcode_parser_get(&words, 'S', 0) / GCODE_FIXED_SCALE;
+            break;
+
+        case 5:
+            // M5 - Stop motor
+            pack_stage(state, PACK_STAGE_TRIM);
+            state->pending.flags |= OEB_FLAG_TRIM;
+            break;
+
+        case 41:
+        case 42:
+            // M41, M42 - Thread tension (the dwell after a change is handled on the next line)
+            if ((m_code == 42) == state->is_tensioned)
+                break;
+            state->is_tension_changed = true;
+            pack_stage(state, PACK_STAGE_TENSION);
+            state->is_tensioned = m_code == 42;
+            state->pending.flags ^= OEB_FLAG_TENSION;
+            break;
+
+        case 201:
+            // M201 - Set accelerations (X and Y are modal, Z has default value)
+            acceleration_x = gcode_parser_get(&words, 'X', acceleration_x * GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE;
+            acceleration_y = gcode_parser_get(&words, 'Y', acceleration_y * GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE;
+            if (acceleration_x != PACK_UNKNOWN && acceleration_x != state->acceleration_x) {
+                pack_control(state, OEB_CONTROL_ACCELERATION_X, acceleration_x, PACK_STAGE_MOVE);
+                state->acceleration_x = acceleration_x;
+            }
+            if (acceleration_y != PACK_UNKNOWN && acceleration_y != state->acceleration_y) {
+                pack_control(state, OEB_CONTROL_ACCELERATION_Y, acceleration_y, PACK_STAGE_MOVE);
+                state->acceleration_y = acceleration_y;
+            }
+            code = gcode_parser_get(&words, 'Z', PACK_ACCELERATION_Z_DEFAULT * GCODE_FIXED_SCALE) / GCODE_FIXED_SCALE;
+            if (code != state->acceleration_z) {
+                pack_control(state, OEB_CONTROL_ACCELERATION_Z, code, PACK_STAGE_STITCH);
+                state->acceleration_z = code;
+            }
+            break;
+
+        default:
+            // M17, M18 and M73 are issued by the reader
+            break;
+        }
+    }
+
+    pack_flush(state);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    pack_state_t state;
+    std::string gcode;
+    int i = 1;
+
+    memset(&state, 0, sizeof(state));
+    state.header.steps_per_mm_x = PACK_STEPS_PER_MM_X;
+    state.header.steps_per_mm_y = PACK_STEPS_PER_MM_Y;
+
+    // Options
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-x") == 0)
+            state.header.steps_per_mm_x = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-y") == 0)
+            state.header.steps_per_mm_y = atoi(argv[i + 1]);
+        else
+            break;
+    }
+
+    if (argc - i != 2) {
+        fprintf(stderr, "Usage: %s [-x steps_per_mm_x] [-y steps_per_mm_y] design.dst|design.gcode output.oeb\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (!design_load_gcode(argv[i], gcode)) {
+        fprintf(stderr, "Can't read %s\n", argv[i]);
+        return 1;
+    }
+
+    state.file = fopen(argv[i + 1], "wb");
+    if (!state.file) {
+        fprintf(stderr, "Can't write %s\n", argv[i + 1]);
+        return 1;
+    }
+
+    memcpy(state.header.magic, OEB_MAGIC, OEB_MAGIC_LENGTH);
+    state.header.header_size = sizeof(oeb_header_t);
+    state.header.record_size = sizeof(oeb_record_t);
+    state.jump_speed = state.stitch_speed = PACK_UNKNOWN;
+    state.acceleration_x = state.acceleration_y = state.acceleration_z = PACK_UNKNOWN;
+    pack_flush(&state);
+
+    // Header is written again when all records are known
+    fwrite(&state.header, sizeof(state.header), 1, state.file);
+    if (!pack_gcode(&state, design_split_lines(gcode))) {
+        fclose(state.file);
+        remove(argv[i + 1]);
+        return 1;
+    }
+    fseek(state.file, 0, SEEK_SET);
+    fwrite(&state.header, sizeof(state.header), 1, state.file);
+    fclose(state.file);
+
+    size_t size = sizeof(oeb_header_t) + (size_t)state.header.record_count * sizeof(oeb_record_t);
+    printf("%s: %zu bytes of G-code -> %zu bytes (%u records, %u stitches, %u colors, %.1f -> %.1f bytes/stitch)\n",
+           argv[i + 1], gcode.size(), size, state.header.record_count, state.header.stitch_count,
+           state.header.color_count, state.header.stitch_count ? (double)gcode.size() / state.header.stitch_count : 0.,
+           state.header.stitch_count ? (double)size / state.header.stitch_count : 0.);
+    return 0;
+}
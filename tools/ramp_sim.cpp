@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// Host-side simulation of the hoop speed ramps (COORDINATED_MOVES, S_CURVE_MOVES)
+// Runs every stitch and jump of the designs through the firmware ramp (src/line_ramp.cpp) slice by slice,
+// once with constant acceleration and once with limited jerk (optionally with a higher peak acceleration), and compares move durations, peak acceleration
+// and peak jerk of the lead axis. Each move starts and ends at standstill (as stitches do).
+// The step from the minimal speed to standstill after the last step is reported separately as the stop speed.
+// Fails if the peak jerk of the jerk-limited ramp is above the limit
+//
+// Build: g++ -O2 -I include -o ramp_sim tools/ramp_sim.cpp src/line_ramp.cpp src/fixed_math.cpp
+// Usage: ./ramp_sim [-a acceleration_mm_s2] [-s s_curve_acceleration_mm_s2] [-j jerk_mm_s3] examples/*.dst
+
+#include <stdlib.h>
+
+#include "dst_design.hpp"
+#include "line_ramp.hpp"
+
+// Same as include/config.hpp and include/motors.hpp
+#define STEPS_PER_MM_X 90
+#define STEPS_PER_MM_Y 65
+#define SLICES_PER_S 500
+#define MAX_STEPS_PER_SLICE 64
+#define MAX_ACCELERATION 262143
+#define MAX_JERK 90000
+
+#define JERK_DEFAULT 10000
+
+// Allowed jerk above the limit from rounding to steps per slice^3 (1/1000)
+#define JERK_TOLERANCE 1.001
+
+// Results of one ramp type
+typedef struct {
+    double duration;
+    double acceleration_peak;
+    double jerk_peak;
+    double stop_speed;
+} ramp_result_t;
+
+/**
+ * @brief Simulates one move from standstill to standstill (same conversions as motors_move_line())
+ * 
+ * @param steps_lead - steps of the lead axis
+ * @param distance - move length (hundredths of mm)
+ * @param speed - mm/s
+ * @param acceleration - mm/s^2
+ * @param jerk - mm/s^3 (0 - constant acceleration)
+ * @param result - duration (s) is added, peaks (mm/s^2, mm/s^3, mm/s of the lead axis) are updated
+ */
+static void simulate_move(uint32_t steps_lead, uint32_t distance, uint32_t speed, uint32_t acceleration,
+                          uint32_t jerk, ramp_result_t *result) {
+    line_ramp_t ramp;
+    uint32_t steps_per_mm = steps_lead * 100 / distance, remainder = steps_lead * 100 % distance;
+    uint32_t speed_steps, acceleration_steps, jerk_steps, done = 0, fraction = 0, steps;
+    int64_t velocity_previous = 0, acceleration_previous = 0, acceleration_slice;
+
+    speed_steps = speed * steps_per_mm + speed * remainder / distance;
+    if (speed_steps > MAX_STEPS_PER_SLICE * SLICES_PER_S)
+        speed_steps = MAX_STEPS_PER_SLICE * SLICES_PER_S;
+    acceleration_steps = acceleration * steps_per_mm + acceleration * remainder / distance;
+    if (acceleration_steps > MAX_ACCELERATION)
+        acceleration_steps = MAX_ACCELERATION;
+    if (jerk > MAX_JERK)
+        jerk = MAX_JERK;
+    jerk_steps = (jerk * steps_per_mm + jerk * remainder / distance)
+                 / ((uint32_t)SLICES_PER_S * SLICES_PER_S * SLICES_PER_S >> LINE_RAMP_FRACTION_BITS);
+    if (jerk > 0 && jerk_steps == 0)
+        jerk_steps = 1;
+
+    line_ramp_start(&ramp, 0, (speed_steps << LINE_RAMP_FRACTION_BITS) / SLICES_PER_S,
+                    0, acceleration_steps * (1 << (LINE_RAMP_FRACTION_BITS - 2)) / (SLICES_PER_S * SLICES_PER_S / 4),
+                    jerk_steps);
+
+    // Units of the lead axis: 1/65536 of step per slice^n -> mm/s^n
+    const double scale = 1. / 65536. / (steps_lead * 100. / distance);
+
+    while (done < steps_lead) {
+        fraction += line_ramp_next(&ramp, steps_lead - done);
+        steps = fraction >> LINE_RAMP_FRACTION_BITS;
+        fraction &= (1 << LINE_RAMP_FRACTION_BITS) - 1;
+
+        // Last slice is shorter
+        if (steps >= steps_lead - done) {
+            result->duration += (double)(steps_lead - done) / steps / SLICES_PER_S;
+            done = steps_lead;
+        }
+        else {
+            result->duration += 1. / SLICES_PER_S;
+            done += steps;
+        }
+
+        // Acceleration and jerk of the slice
+        acceleration_slice = (int64_t)ramp.velocity - velocity_previous;
+        velocity_previous = ramp.velocity;
+        result->acceleration_peak = fmax(result->acceleration_peak,
+                                         fabs((double)acceleration_slice) * scale * SLICES_PER_S * SLICES_PER_S);
+        result->jerk_peak = fmax(result->jerk_peak, fabs((double)(acceleration_slice - acceleration_previous))
+                                                    * scale * SLICES_PER_S * SLICES_PER_S * SLICES_PER_S);
+        acceleration_previous = acceleration_slice;
+    }
+
+    // Motor stops after the last step (from the minimal speed, same for both ramps)
+    result->stop_speed = fmax(result->stop_speed, velocity_previous * scale * SLICES_PER_S);
+}
+
+int main(int argc, char **argv) {
+    uint32_t acceleration = DESIGN_ACCELERATION_X, acceleration_s_curve = 0, jerk = JERK_DEFAULT;
+    int i = 1;
+    bool is_failed = false;
+
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "-a") == 0)
+            acceleration = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0)
+            acceleration_s_curve = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-j") == 0)
+            jerk = atoi(argv[i + 1]);
+    }
+    if (i >= argc || acceleration == 0 || jerk == 0) {
+        fprintf(stderr, "Usage: %s [-a acceleration_mm_s2] [-s s_curve_acceleration_mm_s2] [-j jerk_mm_s3] "
+                "design.dst ...\n", argv[0]);
+        return 1;
+    }
+    if (acceleration_s_curve == 0)
+        acceleration_s_curve = acceleration;
+
+    printf("acceleration %u mm/s^2, s-curve acceleration %u mm/s^2, jerk %u mm/s^3 (lead axis peaks)\n",
+           acceleration, acceleration_s_curve, jerk);
+    printf("%-24s %7s %12s %12s %8s %12s %12s %12s %12s %10s %10s\n", "file", "moves", "trapezoid s", "s-curve s",
+           "slower", "trap acc", "s-curve acc", "trap jerk", "s-curve jerk", "trap stop", "s-c stop");
+
+    for (; i < argc; i++) {
+        std::vector<dst_stitch_t> stitches;
+        if (!dst_read(argv[i], stitches)) {
+            fprintf(stderr, "Can't read %s\n", argv[i]);
+            return 1;
+        }
+
+        ramp_result_t trapezoid = {0, 0, 0, 0}, s_curve = {0, 0, 0, 0};
+        int32_t x = 0, y = 0;
+        uint32_t moves = 0;
+        for (const dst_stitch_t &stitch : stitches) {
+            // 0.1 mm -> hundredths and steps
+            int32_t x_d = abs(stitch.x - x) * 10, y_d = abs(stitch.y - y) * 10;
+            uint32_t steps_x = x_d * STEPS_PER_MM_X / 100, steps_y = y_d * STEPS_PER_MM_Y / 100;
+            uint32_t distance = isqrt32(x_d * x_d + y_d * y_d);
+            uint32_t speed = stitch.type == DST_STITCH ? DESIGN_STITCH_SPEED : DESIGN_JUMP_SPEED;
+            x = stitch.x;
+            y = stitch.y;
+            if (distance == 0 || (steps_x == 0 && steps_y == 0))
+                continue;
+
+            moves++;
+            simulate_move(steps_x > steps_y ? steps_x : steps_y, distance, speed, acceleration, 0, &trapezoid);
+            simulate_move(steps_x > steps_y ? steps_x : steps_y, distance, speed, acceleration_s_curve, jerk,
+                          &s_curve);
+        }
+
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        printf("%-24s %7u %12.1f %12.1f %7.1f%% %12.0f %12.0f %12.0f %12.0f %10.1f %10.1f\n", name, moves,
+               trapezoid.duration, s_curve.duration, (s_curve.duration / trapezoid.duration - 1) * 100,
+               trapezoid.acceleration_peak, s_curve.acceleration_peak, trapezoid.jerk_peak, s_curve.jerk_peak,
+               trapezoid.stop_speed, s_curve.stop_speed);
+
+        if (s_curve.jerk_peak > (jerk < MAX_JERK ? jerk : MAX_JERK) * JERK_TOLERANCE) {
+            fprintf(stderr, "%s: s-curve jerk %.0f mm/s^3 is above the limit %u mm/s^3\n", name, s_curve.jerk_peak,
+                    jerk < MAX_JERK ? jerk : MAX_JERK);
+            is_failed = true;
+        }
+    }
+    return is_failed ? 1 : 0;
+}
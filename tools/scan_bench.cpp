@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2022 Fern H., OpenEmbroidery project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+// Host-side benchmark of the job pre-scan (JOB_PRE_SCAN)
+// Feeds every line through the firmware tokenizer (src/gcode_parser.cpp) and job estimate (src/job_estimate.cpp)
+// in the same way as gcode_read_ahead() and gcode_estimate() do, prints the results and the scan time.
+// Moves stop at every point (no look-ahead for JUNCTION_DEVIATION), so the duration is an upper bound
+//
+// Build: g++ -O2 -I include -o scan_bench tools/scan_bench.cpp src/gcode_parser.cpp src/job_estimate.cpp src/fixed_math.cpp
+// Usage: ./scan_bench examples/*.dst [file.gcode ...]
+
+#include <chrono>
+
+#include "dst_design.hpp"
+#include "gcode_parser.hpp"
+#include "job_estimate.hpp"
+
+// Same as include/config.hpp
+#define SPEED_INITIAL_XY_MM_S 10
+#define SPEED_INITIAL_Z_HZ 200
+#define ACCELERATION_INITIAL_X_MM_S 300
+#define ACCELERATION_INITIAL_Y_MM_S 500
+#define ACCELERATION_INITIAL_Z_HZ 10000
+#define STEPS_PER_REVOLUTION_Z 200
+
+#define ITERATIONS 50
+
+static gcode_words_t words;
+
+/**
+ * @brief Returns integer part of the code (same as gcode_parse_code())
+ */
+static int32_t parse_code(char code, int32_t default_value) {
+    if (words.mask & GCODE_WORD_BIT(code))
+        return words.value[code - 'A'] / GCODE_FIXED_SCALE;
+    return default_value;
+}
+
+/**
+ * @brief Scans all lines (mirrors gcode_read_ahead() with modal values)
+ */
+static void scan(const std::vector<std::string> &lines, job_estimate_t *estimate) {
+    int32_t x = 0, y = 0;
+    uint32_t speed_xy = SPEED_INITIAL_XY_MM_S;
+    uint32_t acceleration_x = ACCELERATION_INITIAL_X_MM_S, acceleration_y = ACCELERATION_INITIAL_Y_MM_S;
+
+    job_estimate_reset(estimate, 0, 0, acceleration_x, acceleration_y, ACCELERATION_INITIAL_Z_HZ,
+                       STEPS_PER_REVOLUTION_Z);
+
+    for (const std::string &line : lines) {
+        gcode_parser_tokenize(line.c_str(), &words);
+
+        switch (parse_code('G', -1)) {
+            case 0:
+            case 1:
+                x = gcode_parser_get(&words, 'X', x);
+                y = gcode_parser_get(&words, 'Y', y);
+                speed_xy = parse_code('F', speed_xy);
+                job_estimate_move(estimate, x, y, speed_xy, 0);
+                break;
+
+            case 4:
+                job_estimate_dwell(estimate, parse_code('P', 0));
+                break;
+
+            default:
+                break;
+        }
+
+        switch (parse_code('M', -1)) {
+            case 0:
+                job_estimate_pause(estimate, parse_code('C', 0));
+                break;
+
+            case 3:
+                if (parse_code('I', 0) > 0)
+                    job_estimate_stitch(estimate, parse_code('S', SPEED_INITIAL_Z_HZ));
+                break;
+
+            case 201:
+                acceleration_x = parse_code('X', acceleration_x);
+                acceleration_y = parse_code('Y', acceleration_y);
+                job_estimate_acceleration(estimate, acceleration_x, acceleration_y,
+                                          parse_code('Z', ACCELERATION_INITIAL_Z_HZ));
+                break;
+
+            default:
+                break;
+        }
+    }
+    job_estimate_finish(estimate);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s design.dst|design.gcode ...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-28s %8s %8s %6s %6s %14s %10s %12s\n", "file", "lines", "stitches", "jumps", "colors",
+           "size mm", "duration", "scan us");
+
+    for (int i = 1; i < argc; i++) {
+        std::string gcode;
+        if (!design_load_gcode(argv[i], gcode)) {
+            fprintf(stderr, "Can't read %s\n", argv[i]);
+            return 1;
+        }
+        std::vector<std::string> lines = design_split_lines(gcode);
+
+        job_estimate_t estimate;
+        std::chrono::steady_clock::time_point time_start = std::chrono::steady_clock::now();
+        for (int iteration = 0; iteration < ITERATIONS; iteration++)
+            scan(lines, &estimate);
+        std::chrono::nanoseconds time_scan = std::chrono::steady_clock::now() - time_start;
+
+        char size[32], duration[16];
+        snprintf(size, sizeof(size), "%.1fx%.1f", (estimate.x_max - estimate.x_min) / 100.,
+                 (estimate.y_max - estimate.y_min) / 100.);
+        snprintf(duration, sizeof(duration), "%u:%02u:%02u", estimate.duration / 3600000,
+                 estimate.duration / 60000 % 60, estimate.duration / 1000 % 60);
+
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        printf("%-28s %8zu %8u %6u %6u %14s %10s %12.1f\n", name, lines.size(), estimate.stitch_count,
+               estimate.jump_count, estimate.color_count, size, duration,
+               time_scan.count() / 1000. / ITERATIONS);
+    }
+    return 0;
+}